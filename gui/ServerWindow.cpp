@@ -1,6 +1,9 @@
 ﻿#include "ServerWindow.hpp"
 #include "ui_ServerWindow.h"
 #include <QMessageBox>
+#include <QScrollBar>
+#include <QDateTime>
+#include <QCloseEvent>
 #include <QDebug>
 #include <Logger.hpp>
 
@@ -17,6 +20,7 @@ ServerWindow::ServerWindow(QWidget* parent)
     connect(ui->stopButton, &QPushButton::clicked, this, &ServerWindow::onStopServerClicked);
    // connect(ui->fileListWidget, &QTreeWidget::itemClicked, this, &ServerWindow::onFileSelected);
     connect(ui->refreshFilesButton, &QPushButton::clicked, this, &ServerWindow::refreshFileList);
+    connect(ui->fileListWidget->verticalScrollBar(), &QScrollBar::valueChanged, this, &ServerWindow::onFileListScrolled);
     connect(ui->downloadHistoryButton, &QPushButton::clicked, this, &ServerWindow::onDownloadHistoryClicked);
     connect(ui->metadataButton, &QPushButton::clicked, this, &ServerWindow::onMetadataClicked);
 
@@ -25,13 +29,28 @@ ServerWindow::ServerWindow(QWidget* parent)
 
 ServerWindow::~ServerWindow()
 {
+    // closeEvent() normally lets the server drain first; this is the
+    // fallback for a window destroyed without being closed.
+    if (serverApp_) serverApp_->stop();
     if (serverThread_) {
-        serverThread_->quit();
         serverThread_->wait();
         delete serverThread_;
     }
     delete ui;
 }
+
+// Closing while the server runs starts the drain and keeps the window up,
+// with its status and log live, until the server thread has finished.
+void ServerWindow::closeEvent(QCloseEvent* event)
+{
+    if (!serverThread_) {
+        event->accept();
+        return;
+    }
+    closeRequested_ = true;
+    beginStop();
+    event->ignore();
+}
 void ServerWindow::setServerApp(std::shared_ptr<ServerApp> app) {
     serverApp_ = std::move(app);
 }
@@ -62,25 +81,64 @@ void ServerWindow::onStartServerClicked()
 */
 void ServerWindow::onStopServerClicked()
 {
-    if (serverApp_) serverApp_->stop();
-    if (serverThread_) {
-        serverThread_->quit();
-        serverThread_->wait();
-        delete serverThread_;
-        serverThread_ = nullptr;
+    if (!serverThread_) {
+        if (serverApp_) serverApp_->stop();
+        ui->statusLabel->setText("Stopped");
+        return;
     }
-    showMessage("Server stopped.");
+    beginStop();
+}
+
+// stop() only closes the listeners; start() returns on the server thread
+// once in-flight transfers are drained, which can take up to
+// drainTimeoutSeconds. The GUI thread never waits for it.
+void ServerWindow::beginStop()
+{
+    if (!serverApp_ || !ui->stopButton->isEnabled()) return;
+    serverApp_->stop();
+    ui->stopButton->setEnabled(false);
+    ui->startButton->setEnabled(false);
+    ui->statusLabel->setText("Stopping: draining transfers...");
+    appendLogMessage("[UI] Stopping server, waiting for transfers to finish...");
+}
+
+void ServerWindow::onServerThreadFinished()
+{
+    serverThread_->deleteLater();
+    serverThread_ = nullptr;
+    ui->stopButton->setEnabled(true);
+    ui->startButton->setEnabled(true);
     ui->statusLabel->setText("Stopped");
+    if (closeRequested_) {
+        close();
+        return;
+    }
+    showMessage("Server stopped.");
 }
 
 void ServerWindow::refreshFileList() {
     ui->fileListWidget->clear();
-    auto files = metadataDB_.getAllFileNames();
-    for (const auto& name : files) {
+    fileListCursor_.clear();
+    fetchMoreFiles();
+}
+
+// Appends the next page; the first call after refreshFileList loads page one.
+void ServerWindow::fetchMoreFiles() {
+    bool firstPage = ui->fileListWidget->topLevelItemCount() == 0;
+    if (!firstPage && fileListCursor_.empty()) return;
+
+    FileListPage page = metadataDB_.listFiles(fileListCursor_, FILE_LIST_PAGE_SIZE);
+    for (const auto& entry : page.entries) {
         auto* item = new QTreeWidgetItem();
-        item->setText(0, QString::fromStdString(name));
+        item->setText(0, QString::fromStdString(entry.fileName));
         ui->fileListWidget->addTopLevelItem(item);
     }
+    fileListCursor_ = page.nextCursor;
+}
+
+void ServerWindow::onFileListScrolled(int value) {
+    if (value >= ui->fileListWidget->verticalScrollBar()->maximum())
+        fetchMoreFiles();
 }
 
 void ServerWindow::onMetadataClicked() {
@@ -106,6 +164,8 @@ void ServerWindow::onMetadataClicked() {
     addRow("Size (KB)", QString::number(meta.fileSize / 1024.0, 'f', 2));
     addRow("Last Updated", QString::fromStdString(meta.uploadTimestamp));
     addRow("Download Count", QString::number(meta.downloadCount));
+    if (!meta.checksum.empty())
+        addRow("CRC32", QString::fromStdString(meta.checksum));
 
     ui->metadataTable->resizeColumnsToContents();
 }
@@ -124,6 +184,16 @@ void ServerWindow::onDownloadHistoryClicked() {
         ui->metadataTable->setItem(row, 0, new QTableWidgetItem(QString::fromStdString(user)));
         ui->metadataTable->setItem(row, 1, new QTableWidgetItem(QString::fromStdString(time)));
     }
+
+    // Older history survives only as per-day totals after retention compaction.
+    for (const auto& rollup : metadataDB_.getDownloadRollups(fileName)) {
+        QString day = QDateTime::fromSecsSinceEpoch(rollup.day * 86400, Qt::UTC).toString("yyyy-MM-dd");
+        int row = ui->metadataTable->rowCount();
+        ui->metadataTable->insertRow(row);
+        ui->metadataTable->setItem(row, 0, new QTableWidgetItem(
+            QString("%1 (x%2)").arg(QString::fromStdString(rollup.downloader)).arg(rollup.downloadCount)));
+        ui->metadataTable->setItem(row, 1, new QTableWidgetItem(day));
+    }
     ui->metadataTable->resizeColumnsToContents();
 }
 
@@ -191,11 +261,15 @@ void ServerWindow::onStartServerClicked()
     serverApp_ = std::make_shared<ServerApp>();
     serverApp_->moveToThread(serverThread_);
 
+    // start() blocks until the server has drained; ending the thread's
+    // event loop then reports back through finished.
     connect(serverThread_, &QThread::started, [this]() {
         serverApp_->start();
+        QThread::currentThread()->quit();
         });
+    connect(serverThread_, &QThread::finished, this, &ServerWindow::onServerThreadFinished);
 
-    connect(serverThread_, &QThread::finished, serverApp_.get(), &QObject::deleteLater);
+    // serverApp_ is owned by the shared_ptr; no deleteLater on thread finish.
     connect(serverApp_.get(), &ServerApp::logMessage, this, &ServerWindow::appendLogMessage);
     connect(serverApp_.get(), &ServerApp::clientConnected, this, &ServerWindow::onClientConnected);
     connect(serverApp_.get(), &ServerApp::clientDisconnected, this, &ServerWindow::onClientDisconnected);
@@ -18,23 +18,34 @@ public:
     ~ServerWindow();
     void setServerApp(std::shared_ptr<ServerApp> app);
 
+protected:
+    void closeEvent(QCloseEvent* event) override;
+
 private slots:
     void onStartServerClicked();
     void onStopServerClicked();
   //  void onFileSelected(QTreeWidgetItem* item, int column);
     void refreshFileList();
+    void fetchMoreFiles();
+    void onFileListScrolled(int value);
     void onMetadataClicked();
     void onDownloadHistoryClicked();
 
     void appendLogMessage(const QString& msg);
     void onClientConnected(const QString& addr);
     void onClientDisconnected(const QString& addr);
+    void onServerThreadFinished();
 
 private:
     Ui::ServerWindow* ui;
     QThread* serverThread_ = nullptr;
     std::shared_ptr<ServerApp> serverApp_;
     MetadataManager metadataDB_;
+    std::string fileListCursor_;            // keyset cursor of the next page, empty when exhausted
+    bool closeRequested_ = false;           // close the window once the server has drained
+
+    static const size_t FILE_LIST_PAGE_SIZE = 200;
 
     void showMessage(const QString& msg);
+    void beginStop();
 };
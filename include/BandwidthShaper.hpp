@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+// Token bucket that refills lazily on each call, so no timer thread is
+// needed. consume() always takes the tokens and lets the balance go
+// negative; the debt is returned as the time the caller should pause.
+class TokenBucket {
+public:
+    explicit TokenBucket(uint64_t bytesPerSecond = 0);
+
+    void setRate(uint64_t bytesPerSecond);      // 0 = unlimited
+    std::chrono::nanoseconds consume(uint64_t bytes);
+
+private:
+    std::mutex mutex_;
+    double rate_ = 0;           // bytes per second
+    double burst_ = 0;          // most tokens that can be saved up
+    double tokens_ = 0;
+    std::chrono::steady_clock::time_point last_;
+};
+
+struct BandwidthLimits {
+    uint64_t globalBytesPerSecond = 0;          // 0 = unlimited
+    uint64_t perUserBytesPerSecond = 0;
+    uint64_t perSessionBytesPerSecond = 0;
+};
+
+// Hierarchical shaping: every byte a session moves is charged to its own
+// bucket, its user's bucket and the global one, and the session waits for
+// whichever is deepest in debt. Per-user buckets live as long as that user
+// has an open session.
+class BandwidthShaper {
+public:
+    static const int BURST_MS = 250;            // bucket depth, in time at the configured rate
+    static const int MIN_PAUSE_US = 2000;       // smaller debts are carried over, not slept off
+
+    class Session {
+    public:
+        // Call after moving `bytes`; sleeps if any bucket is over its rate.
+        void throttle(uint64_t bytes);
+
+    private:
+        friend class BandwidthShaper;
+        std::shared_ptr<TokenBucket> global_;
+        std::shared_ptr<TokenBucket> user_;
+        std::shared_ptr<TokenBucket> session_;
+    };
+
+    BandwidthShaper();
+
+    void configure(const BandwidthLimits& limits);      // applies to open sessions too
+    std::unique_ptr<Session> openSession(const std::string& user);
+
+private:
+    std::mutex mutex_;
+    BandwidthLimits limits_;
+    std::shared_ptr<TokenBucket> global_;
+    std::unordered_map<std::string, std::weak_ptr<TokenBucket>> users_;
+    std::vector<std::weak_ptr<TokenBucket>> sessions_;
+};
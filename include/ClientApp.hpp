@@ -1,7 +1,16 @@
 #pragma once
 #include <string>
+#include <cstdint>
 #include <atomic>
 #include <unordered_map>
+#include <vector>
+
+struct RemoteFileInfo {
+    std::string fileName;
+    long long fileSize = 0;
+    long long uploadTime = 0;       // Unix epoch seconds
+    std::string uploader;
+};
 
 class ClientApp {
 public:
@@ -11,20 +20,37 @@ public:
     bool uploadFile(const std::string& filePath, const std::string& user, bool compress = false);
     bool downloadFile(const std::string& fileName, const std::string& user, bool compress = false, bool resume = false);
     bool queryMetadata(const std::string& fileName); // Ask server for metadata
+    // One page of the server's file list; pass the returned nextCursor back to continue.
+    bool listFiles(const std::string& cursor, size_t pageSize, const std::string& prefix,
+        std::vector<RemoteFileInfo>& files, std::string& nextCursor);
+    bool searchFiles(const std::string& query, size_t limit, std::vector<RemoteFileInfo>& files);
     void disconnect();
-    void setServerAddress(const std::string& ip) { serverAddress_ = ip; }
-    void setServerPort(int port) { serverPort_ = port; }
+    void setServerAddress(const std::string& ip) { serverAddress_ = ip; capsKnown_ = false; }
+    void setServerPort(int port) { serverPort_ = port; capsKnown_ = false; }
     bool isConnected() const { return connected_; }
 
+    static constexpr int MAX_BUSY_RETRIES = 5;      // transfers turned away with BUSY
+    // Smaller files are sent outright: hashing them and the UPLOADREF round
+    // trip cost more than the transfer they might save.
+    static constexpr uint64_t REF_UPLOAD_MIN_BYTES = 1024 * 1024;
+
 private:
     bool loadConfig();                              // Load config (IP, port, etc.)
     long getResumeOffset(const std::string& fileName);
     void saveResumeOffset(const std::string& fileName, long offset);
     void clearResumeData(const std::string& fileName);
+    bool uploadByReference(const std::string& filePath, const std::string& username);
+    bool serverTakesReferences();
+    bool recvLine(std::string& line);
+    bool recvFileEntries(std::vector<RemoteFileInfo>& files, std::string& trailer);
+    bool waitAndReconnect(int seconds);
     std::string configPath_;
     std::string serverAddress_ = "127.0.0.1";
     int serverPort_{2121};
     int clientSocket_{-1};
     std::atomic<bool> connected_{ false };
     std::unordered_map<std::string, long> resumeMap_;  // in-memory resume offsets
+    std::string recvBuffer_;                           // bytes received past the last line
+    bool capsKnown_ = false;                           // CAPS asked of this server
+    bool uploadRefs_ = false;                          // server advertised UPLOADREF
 };
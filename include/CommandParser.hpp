@@ -1,12 +1,64 @@
 #pragma once
-#include <string>
-#include <vector>
+#include <string_view>
+#include <array>
+#include <cstdint>
+#include <charconv>
+#include <system_error>
 
+enum class CommandType { Unknown, Upload, UploadRef, Download, List, Search, Caps };
+
+// Non-owning whitespace tokenizer over one protocol line. Tokens are views
+// into the input, which must outlive the parser; nothing is allocated.
 class CommandParser {
 public:
-    explicit CommandParser(const std::string& input);
-    std::string getCommand() const;
-    std::string getArg(size_t index) const;
+    static const size_t MAX_TOKENS = 16;
+
+    explicit CommandParser(std::string_view input);
+
+    CommandType type() const { return type_; }
+    std::string_view getCommand() const;
+    std::string_view getArg(size_t index) const;
+    size_t argCount() const { return count_ ? count_ - 1 : 0; }
+
+    // Everything from argument `index` to the end of the line, e.g. SEARCH terms.
+    std::string_view getRest(size_t index) const;
+
+    // Parses argument `index` as a decimal number; false if missing or malformed.
+    template <typename T>
+    bool getNumber(size_t index, T& value) const {
+        std::string_view token = getArg(index);
+        if (token.empty()) return false;
+        const char* end = token.data() + token.size();
+        auto [ptr, ec] = std::from_chars(token.data(), end, value);
+        return ec == std::errc() && ptr == end;
+    }
+
+    static constexpr uint32_t hashName(std::string_view name) {
+        uint32_t hash = 2166136261u;            // FNV-1a
+        for (char c : name) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // Case labels are hashName() of every command, so the compiler rejects
+    // any collision: the switch is a perfect hash over the command set.
+    static constexpr CommandType lookup(std::string_view name) {
+        switch (hashName(name)) {
+        case hashName("UPLOAD"):   return name == "UPLOAD" ? CommandType::Upload : CommandType::Unknown;
+        case hashName("UPLOADREF"): return name == "UPLOADREF" ? CommandType::UploadRef : CommandType::Unknown;
+        case hashName("DOWNLOAD"): return name == "DOWNLOAD" ? CommandType::Download : CommandType::Unknown;
+        case hashName("LIST"):     return name == "LIST" ? CommandType::List : CommandType::Unknown;
+        case hashName("SEARCH"):   return name == "SEARCH" ? CommandType::Search : CommandType::Unknown;
+        case hashName("CAPS"):     return name == "CAPS" ? CommandType::Caps : CommandType::Unknown;
+        default:                   return CommandType::Unknown;
+        }
+    }
+
 private:
-    std::vector<std::string> tokens_;
-};
\ No newline at end of file
+    std::string_view input_;
+    std::array<std::string_view, MAX_TOKENS> tokens_{};
+    size_t count_ = 0;
+    CommandType type_ = CommandType::Unknown;
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <cstdint>
+
+struct FileMetadata;
+
+// Gzipped copies of stored files under "<storage>/.variants", so a repeated
+// compressed download sends a finished file rather than compressing again.
+// A variant is named after the file and a hash of its version
+// (HotFileCache::versionOf): one made before a re-upload is never found for
+// the new content, and invalidate() deletes it. Only files downloaded
+// minDownloads times get one, and the variants are bounded by
+// capacityBytes in total with LRU eviction.
+class CompressedVariants {
+public:
+    static constexpr const char* VARIANT_DIR = ".variants";
+    static const uint64_t DEFAULT_CAPACITY_BYTES = 1024ULL * 1024 * 1024;
+    static const int DEFAULT_MIN_DOWNLOADS = 2;
+
+    // Indexes the variants already on disk, least recently written first.
+    void open(const std::string& storageDir);
+    // capacityBytes 0 keeps no variants (and deletes the ones kept).
+    void configure(uint64_t capacityBytes, int minDownloads);
+
+    // A variant held open for a download: while any handle to it exists,
+    // invalidation or eviction only unindexes it and the file is deleted
+    // when the last handle goes. Empty if there was no variant.
+    class Handle {
+    public:
+        Handle() = default;
+        Handle(Handle&& other) noexcept
+            : owner_(other.owner_), path_(std::move(other.path_)), size_(other.size_) { other.owner_ = nullptr; }
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        Handle& operator=(Handle&&) = delete;
+        ~Handle() { if (owner_) owner_->release(path_); }
+
+        explicit operator bool() const { return owner_ != nullptr; }
+        const std::string& path() const { return path_; }
+        uint64_t size() const { return size_; }
+
+    private:
+        friend class CompressedVariants;
+        Handle(CompressedVariants* owner, std::string path, uint64_t size)
+            : owner_(owner), path_(std::move(path)), size_(size) {}
+
+        CompressedVariants* owner_ = nullptr;
+        std::string path_;
+        uint64_t size_ = 0;
+    };
+
+    // Whether a compressed download of this file should keep its gzip.
+    bool admits(const FileMetadata& meta) const;
+    // The gzip variant of this version of the file, with its size as indexed.
+    Handle find(const FileMetadata& meta);
+    // Moves a finished gzip of the file into place as its variant,
+    // replacing variants of its other versions.
+    bool publish(const std::string& compressedPath, const FileMetadata& meta);
+    // Deletes every variant of the file, whatever version it was made from.
+    void invalidate(const std::string& fileName);
+
+    uint64_t bytes() const;
+
+private:
+    struct Entry {
+        std::string path;
+        uint64_t size = 0;
+    };
+
+    std::string pathFor(const FileMetadata& meta) const;
+    void removeVersionsLocked(const std::string& fileName, const std::string& keep);
+    void removeLocked(const std::string& path);
+    void evictLocked();
+    void release(const std::string& path);
+
+    mutable std::mutex mutex_;
+    std::string storageDir_;
+    uint64_t capacityBytes_ = DEFAULT_CAPACITY_BYTES;
+    int minDownloads_ = DEFAULT_MIN_DOWNLOADS;
+    uint64_t bytes_ = 0;
+    std::list<Entry> lru_;                  // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::unordered_map<std::string, int> inUse_;   // handles per path
+    std::unordered_set<std::string> doomed_;       // removed while in use
+};
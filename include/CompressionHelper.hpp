@@ -1,12 +1,20 @@
 #pragma once
 #include <string>
+#include <cstdint>
 
 class CompressionHelper {
 public:
     // Compress inputPath -> outputPath using gzip
     static bool compressFile(const std::string& inputPath, const std::string& outputPath);
 
-    // Decompress inputPath -> outputPath
+    // Compress data -> output in memory, same gzip format as compressFile
+    static bool compressBuffer(const char* data, size_t length, std::string& output);
+
+    // Decompress inputPath -> outputPath; false if the input is not a
+    // complete gzip stream or the output could not be written
     static bool decompressFile(const std::string& inputPath, const std::string& outputPath);
+    // Same, but fails with overLimit set once the output would pass maxOutput bytes
+    static bool decompressFile(const std::string& inputPath, const std::string& outputPath,
+        uint64_t maxOutput, bool& overLimit);
 };
     
\ No newline at end of file
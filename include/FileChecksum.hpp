@@ -0,0 +1,18 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+class TaskScheduler;
+
+class FileChecksum {
+public:
+    static const size_t SEGMENT_SIZE = 4 * 1024 * 1024;
+
+    // CRC32 of the whole file. Files of more than one segment are hashed
+    // segment by segment on the scheduler and the results joined with
+    // crc32_combine; smaller files (or a null scheduler) are hashed inline.
+    static bool crc32File(const std::string& path, TaskScheduler* scheduler, uint32_t& crc);
+    static uint32_t crc32Buffer(const char* data, size_t length);
+
+    static std::string toHex(uint32_t crc);
+};
@@ -13,6 +13,15 @@ public:
     bool sendAll(int socket, const char* buffer, size_t length);
     bool recvAll(int socket, char* buffer, size_t length);
 
+    // Seconds the server asked to wait when it turned the last transfer away
+    // with BUSY, 0 otherwise.
+    int busyRetryAfter() const { return busyRetryAfter_; }
+
     static const size_t CHUNK_SIZE = 64 * 1024; // 64KB chunks
 
+private:
+    bool recvReply(int socket, std::string& line);
+
+    int busyRetryAfter_ = 0;
+
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "MetadataManager.hpp"
+
+// The encodings a download can be served in.
+enum class HotVariant : uint8_t { Raw, Gzip };
+
+struct HotFileCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t bytes = 0;
+    uint64_t capacityBytes = 0;
+    size_t entries = 0;
+};
+
+// Byte-bounded LRU of the contents of popular small files, raw and gzipped,
+// so repeated downloads are sent from memory. Only files at most
+// maxFileBytes long with at least minDownloads recorded downloads are
+// admitted. Entries carry a version built from the file's metadata; a
+// re-upload changes it, so a stale entry is never served even if it was
+// inserted after the upload invalidated the name.
+class HotFileCache {
+public:
+    using Data = std::shared_ptr<const std::string>;
+
+    static const uint64_t DEFAULT_CAPACITY_BYTES = 64ULL * 1024 * 1024;
+    static const uint64_t DEFAULT_MAX_FILE_BYTES = 1024 * 1024;
+    static const int DEFAULT_MIN_DOWNLOADS = 3;
+
+    // capacityBytes 0 turns the cache off (and empties it).
+    void configure(uint64_t capacityBytes, uint64_t maxFileBytes, int minDownloads);
+
+    bool admits(const FileMetadata& meta) const;
+    static std::string versionOf(const FileMetadata& meta);
+
+    Data get(const std::string& fileName, HotVariant variant, const std::string& version);
+    void put(const std::string& fileName, HotVariant variant, const std::string& version, Data data);
+    // Drops every variant of the file.
+    void invalidate(const std::string& fileName);
+
+    HotFileCacheStats stats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::string version;
+        Data data;
+    };
+
+    static std::string keyOf(const std::string& fileName, HotVariant variant);
+    void evictTo(uint64_t capacityBytes);      // called with mutex_ held
+
+    mutable std::mutex mutex_;
+    uint64_t capacityBytes_ = DEFAULT_CAPACITY_BYTES;
+    uint64_t maxFileBytes_ = DEFAULT_MAX_FILE_BYTES;
+    int minDownloads_ = DEFAULT_MIN_DOWNLOADS;
+    uint64_t bytes_ = 0;
+    std::list<Entry> lru_;                                   // front = most recently used
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+    std::atomic<uint64_t> hits_{ 0 };
+    std::atomic<uint64_t> misses_{ 0 };
+    std::atomic<uint64_t> evictions_{ 0 };
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Structured log events. Call sites record only the event id and typed
+// arguments (see LOG_EVENT_* in Logger.hpp); the text is produced offline by
+// ftp_lite_logdecode from this table. Ids are persisted in .bin log files:
+// append new events, never renumber or reuse old ones.
+enum class LogEvent : uint16_t {
+    UploadProgress = 1,         // client: file, percent
+    DownloadProgress = 2,       // client: file, bytes received
+    UploadChunkReceived = 3,    // server: file, bytes received, declared size
+    UploadResumed = 4,          // client: file, offset
+};
+
+struct LogEventInfo {
+    LogEvent id;
+    const char* name;
+    const char* format;         // "{}" placeholders are filled with the arguments in order
+};
+
+inline constexpr LogEventInfo LOG_EVENT_TABLE[] = {
+    { LogEvent::UploadProgress,      "upload_progress",       "Upload progress: {} {}%" },
+    { LogEvent::DownloadProgress,    "download_progress",     "Download progress: {} {} bytes" },
+    { LogEvent::UploadChunkReceived, "upload_chunk_received", "Upload chunk: {} {}/{} bytes" },
+    { LogEvent::UploadResumed,       "upload_resumed",        "Resuming upload of {} from offset {}" },
+};
+
+inline const LogEventInfo* findLogEvent(uint16_t id) {
+    for (const auto& info : LOG_EVENT_TABLE)
+        if (static_cast<uint16_t>(info.id) == id) return &info;
+    return nullptr;
+}
+
+// Binary log file layout (little-endian, as written by the host):
+//   file header : "FTPLBIN1"
+//   record      : u32 size (bytes after this field), u64 timestamp ns,
+//                 u16 level, u16 event id, then typed arguments
+//   argument    : u8 tag, payload
+//                 'i' i64 | 'u' u64 | 'd' f64 | 's' u16 length + bytes
+inline constexpr char LOG_BINARY_MAGIC[8] = { 'F', 'T', 'P', 'L', 'B', 'I', 'N', '1' };
@@ -1,9 +1,150 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "LogEvents.hpp"
 
+// Build-time log threshold: 0 = debug, 1 = info, 2 = error. Calls below it
+// compile to nothing, arguments included (set from CMake FTP_LITE_LOG_LEVEL).
+#ifndef FTP_LITE_LOG_LEVEL
+#define FTP_LITE_LOG_LEVEL 1
+#endif
+
+enum class LogLevel : uint16_t { Debug = 0, Info = 1, Error = 2 };
+
+// What a logging thread does when its ring buffer is full.
+enum class LogOverflowPolicy {
+    Drop,       // discard the record and count it (errors always wait)
+    Block       // spin until the writer thread frees space
+};
+
+// When the active log file is rotated. Rotation renames the file (and its
+// ".bin" sibling) to "<name>.<YYYYmmdd-HHMMSS>-<n><ext>" on the writer thread;
+// gzip and pruning of old segments run on a separate background thread.
+struct LogRotationPolicy {
+    uint64_t maxBytes = 0;      // rotate once the segment reaches this size (0 = no size limit)
+    int maxAgeMinutes = 0;      // rotate once the segment is this old (0 = no time limit)
+    int keepFiles = 10;         // rotated segments kept per file
+    bool compress = false;      // gzip rotated segments
+};
+
+// Asynchronous logger. Each calling thread appends records to its own
+// lock-free ring buffer; a background thread formats them and writes them
+// in batches to the file given to init() (and to the console). Nothing on
+// the calling thread takes a lock or touches a stream.
 class Logger {
 public:
     static void init(const std::string& logFile);
+    static void debug(const std::string& message);
     static void info(const std::string& message);
     static void error(const std::string& message);
-};
\ No newline at end of file
+
+    static void setRotation(const LogRotationPolicy& policy);
+    // Runtime threshold on top of FTP_LITE_LOG_LEVEL; errors always pass.
+    static void setLevel(LogLevel level);
+    static void setOverflowPolicy(LogOverflowPolicy policy);
+    static void setConsoleOutput(bool enabled);
+    static uint64_t droppedCount();
+
+    static void flush();        // returns once everything logged so far is written
+    static void shutdown();     // flush and stop the writer thread; later messages are written directly
+
+    static void log(LogLevel level, const char* message, size_t length);
+
+    // Structured record: event id plus typed arguments, encoded into a small
+    // stack buffer and written unformatted to "<logFile>.bin".
+    template <typename... Args>
+    static void event(LogLevel level, LogEvent id, const Args&... args);
+
+private:
+    static void logEvent(LogLevel level, const char* record, size_t length);
+};
+
+namespace logdetail {
+
+class EventEncoder {
+public:
+    static const size_t CAPACITY = 512;
+
+    explicit EventEncoder(LogEvent id) { putRaw(static_cast<uint16_t>(id)); }
+
+    template <typename T>
+    void put(const T& value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            putTagged('u', static_cast<uint64_t>(value));
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            putTagged('i', static_cast<int64_t>(value));
+        }
+        else if constexpr (std::is_integral_v<T>) {
+            putTagged('u', static_cast<uint64_t>(value));
+        }
+        else if constexpr (std::is_floating_point_v<T>) {
+            putTagged('d', static_cast<double>(value));
+        }
+        else {
+            putString(std::string_view(value));
+        }
+    }
+
+    const char* data() const { return buffer_; }
+    size_t size() const { return size_; }
+
+private:
+    template <typename T>
+    void putRaw(const T& value) {
+        if (size_ + sizeof(T) > CAPACITY) return;
+        std::memcpy(buffer_ + size_, &value, sizeof(T));
+        size_ += sizeof(T);
+    }
+
+    template <typename T>
+    void putTagged(char tag, const T& value) {
+        if (size_ + 1 + sizeof(T) > CAPACITY) return;
+        buffer_[size_++] = tag;
+        putRaw(value);
+    }
+
+    void putString(std::string_view text) {
+        if (size_ + 3 > CAPACITY) return;
+        size_t length = text.size();
+        if (length > CAPACITY - size_ - 3) length = CAPACITY - size_ - 3;   // truncate
+        buffer_[size_++] = 's';
+        putRaw(static_cast<uint16_t>(length));
+        std::memcpy(buffer_ + size_, text.data(), length);
+        size_ += length;
+    }
+
+    char buffer_[CAPACITY];
+    size_t size_ = 0;
+};
+
+}
+
+template <typename... Args>
+void Logger::event(LogLevel level, LogEvent id, const Args&... args) {
+    logdetail::EventEncoder encoder(id);
+    (encoder.put(args), ...);
+    logEvent(level, encoder.data(), encoder.size());
+}
+
+#if FTP_LITE_LOG_LEVEL <= 0
+#define LOG_DEBUG(message) Logger::debug(message)
+#define LOG_EVENT_DEBUG(id, ...) Logger::event(LogLevel::Debug, id, __VA_ARGS__)
+#else
+#define LOG_DEBUG(message) do {} while (0)
+#define LOG_EVENT_DEBUG(id, ...) do {} while (0)
+#endif
+
+#if FTP_LITE_LOG_LEVEL <= 1
+#define LOG_INFO(message) Logger::info(message)
+#define LOG_EVENT_INFO(id, ...) Logger::event(LogLevel::Info, id, __VA_ARGS__)
+#else
+#define LOG_INFO(message) do {} while (0)
+#define LOG_EVENT_INFO(id, ...) do {} while (0)
+#endif
+
+#define LOG_ERROR(message) Logger::error(message)
+#define LOG_EVENT_ERROR(id, ...) Logger::event(LogLevel::Error, id, __VA_ARGS__)
@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "MetadataManager.hpp"
+
+struct MetadataCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t size = 0;
+    size_t capacity = 0;
+};
+
+// Bounded LRU cache of FileMetadata keyed by filename. Shared by every
+// MetadataManager opened on the same database file, so the per-client
+// managers in ServerApp and the one in ServerWindow see the same entries.
+class MetadataCache {
+public:
+    static const size_t DEFAULT_CAPACITY = 4096;
+
+    explicit MetadataCache(size_t capacity = DEFAULT_CAPACITY);
+
+    static std::shared_ptr<MetadataCache> forDatabase(const std::string& dbPath);
+
+    // Generation to pass back to put*(); a put is dropped if its own key (or
+    // the name list) was invalidated in between, so a slow reader never
+    // re-inserts a stale row and unrelated invalidations don't cost it.
+    uint64_t generation() const { return generation_.load(); }
+
+    std::optional<FileMetadata> get(const std::string& fileName);
+    void put(const FileMetadata& meta, uint64_t generation);
+    void invalidate(const std::string& fileName);
+
+    std::optional<std::vector<std::string>> getFileNames();
+    void putFileNames(std::vector<std::string> names, uint64_t generation);
+    void invalidateFileNames();
+
+    void clear();
+    MetadataCacheStats stats() const;
+
+private:
+    using Entry = std::pair<std::string, FileMetadata>;
+
+    mutable std::mutex mutex_;
+    size_t capacity_;
+    std::list<Entry> lru_;                                   // front = most recently used
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::optional<std::vector<std::string>> fileNames_;
+
+    // Generation of each key's last invalidation. Trimmed by moving floor_
+    // up to the current generation once it outgrows the cache; puts read
+    // before floor_ are dropped, which is only ever too cautious.
+    std::unordered_map<std::string, uint64_t> invalidatedAt_;
+    uint64_t fileNamesInvalidatedAt_ = 0;
+    uint64_t floor_ = 0;
+
+    std::atomic<uint64_t> generation_{ 0 };
+    std::atomic<uint64_t> hits_{ 0 };
+    std::atomic<uint64_t> misses_{ 0 };
+    std::atomic<uint64_t> evictions_{ 0 };
+};
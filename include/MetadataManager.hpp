@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <tuple>
+#include <memory>
 #include <sqlite3.h>
 
 struct FileMetadata {
@@ -10,11 +11,56 @@ struct FileMetadata {
     std::string uploadTimestamp;
     std::string uploader;
     int downloadCount = 0;
-    std::string storagePath;
+    std::string storagePath;       // relative to the server storagePath, empty = flat legacy layout
+    std::string checksum;          // CRC32 as 8 hex digits, empty if not recorded
+    std::string contentHash;       // SHA-256 of the blob it references, empty if not content-addressed
+    long long packOffset = -1;     // start of the file inside the pack segment at storagePath, -1 = own file
 };
 
+struct DownloadRollup {
+    std::string downloader;
+    long long day = 0;             // days since the Unix epoch (UTC)
+    int downloadCount = 0;
+};
+
+struct FileListEntry {
+    long long id = 0;
+    std::string fileName;
+    long fileSize = 0;
+    long long uploadTime = 0;      // Unix epoch seconds
+    std::string uploader;
+};
+
+// Committed storage per uploader, kept current by triggers on files.
+struct UserUsage {
+    long long bytesUsed = 0;
+    long long fileCount = 0;
+};
+
+// A content-addressed blob; refcount is the number of files naming it.
+struct BlobInfo {
+    std::string hash;
+    long long size = 0;
+    long long refcount = 0;
+    std::string checksum;          // CRC32 of the content, as in FileMetadata
+};
+
+// One page of listFiles(); nextCursor is empty on the last page.
+// invalidCursor is set, with no entries, when the cursor does not parse.
+struct FileListPage {
+    std::vector<FileListEntry> entries;
+    std::string nextCursor;
+    bool invalidCursor = false;
+};
+
+class MetadataCache;
+struct MetadataCacheStats;
+
 class MetadataManager {
 public:
+    static const int SCHEMA_VERSION = 11;
+    static const size_t MAX_PAGE_SIZE = 1000;
+
     explicit MetadataManager(const std::string& dbPath);
     ~MetadataManager();
 
@@ -23,17 +69,73 @@ public:
     // CRUD / update
     //void insertOrUpdateFile(const std::string& fileName, size_t fileSize);
     bool addFileRecord(const std::string& filename, long filesize, const std::string& uploader);
-    void updateFileMetadata(const std::string& fileName, const std::string& uploader, long size);
+    // With a contentHash the blob row is created if needed and the file
+    // becomes a reference to it, in one transaction. A packOffset places the
+    // file inside the pack segment named by storagePath.
+    void updateFileMetadata(const std::string& fileName, const std::string& uploader, long size,
+        const std::string& checksum = "", const std::string& storagePath = "", const std::string& contentHash = "",
+        long long packOffset = -1);
+    bool setStoragePath(const std::string& fileName, const std::string& storagePath);
     //void incrementDownloadCount(const std::string& fileName, const std::string& user = "unknown");
     bool updateDownloadRecord(const std::string& filename, const std::string& downloader);
 
     // Metadata retrieval
     //std::tuple<long, std::string, std::string, int> getFileMetadata(const std::string& filename);
     std::vector<std::tuple<std::string, std::string>> getDownloaders(const std::string& filename);
+    // Per-user, per-day totals for history already compacted out of the downloads table.
+    std::vector<DownloadRollup> getDownloadRollups(const std::string& filename);
+
+    // Retention: folds up to batchSize download rows older than cutoff (epoch seconds)
+    // into download_rollups and deletes them, in one short transaction.
+    // Returns the number of rows compacted, or -1 on error.
+    int compactDownloadHistory(long long cutoff, int batchSize);
 
     std::vector<std::string> getAllFileNames();
+    // Files stored before the sharded layout (no storage_path recorded).
+    std::vector<std::string> getUnshardedFileNames();
+    // Newest first, keyset-paginated on (upload_timestamp, id). Pass an empty
+    // cursor for the first page and the returned nextCursor for the following ones.
+    FileListPage listFiles(const std::string& cursor, size_t pageSize, const std::string& prefix = "");
+    // Ranked substring search over filename and uploader (FTS5 trigram index).
+    // Queries with a term shorter than three characters fall back to a filename prefix scan.
+    std::vector<FileListEntry> searchFiles(const std::string& query, size_t limit);
     FileMetadata getFileMetadataRecord(const std::string& filename);
+    UserUsage getUserUsage(const std::string& uploader);
+
+    // Content-addressed blobs. hash is empty in the result if unknown.
+    BlobInfo getBlob(const std::string& hash);
+    // Deletes the blob row if no file references it; true if it was deleted
+    // (the caller then removes the blob file).
+    bool dropBlobIfUnreferenced(const std::string& hash);
+
+    MetadataCacheStats cacheStats() const;
+
+    // Copies the WAL back into the database file (on shutdown).
+    bool checkpoint();
       
 private:
+    bool execSQL(const char* sql);
+    int schemaVersion();
+    bool migrateSchema();
+    bool migrateToV2();
+    bool migrateToV3();
+    bool migrateToV4();
+    bool migrateToV5();
+    bool migrateToV6();
+    bool migrateToV7();
+    bool migrateToV8();
+    bool migrateToV9();
+    bool migrateToV10();
+    bool migrateToV11();
+
+    // Rows whose filename lies in [prefix, upper), counting no further than limit.
+    long long countPrefixMatches(const std::string& prefix, const std::string& upper, long long limit);
+    // A prefix with at least this many matches is listed by walking the
+    // timestamp index instead of sorting the matches on every page.
+    static const long long PREFIX_SORT_LIMIT = 2000;
+
+    FileMetadata loadFileMetadataRecord(const std::string& filename);
+
     sqlite3* db_ = nullptr;
+    std::shared_ptr<MetadataCache> cache_;
 };
@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+struct SnapshotOptions {
+    std::string dbPath = "server_metadata.db";
+    std::string snapshotDir = "snapshots";
+    int intervalMinutes = 0;        // 0 disables scheduled snapshots
+    int pagesPerStep = 64;          // pages copied per sqlite3_backup_step call
+    int stepPauseMs = 10;           // pause between steps so writers get the lock
+    int keepSnapshots = 5;          // older snapshots are deleted
+    int maxRestarts = 3;            // after this many restarts copy the rest in one step
+};
+
+// Takes consistent point-in-time copies of the metadata database with the
+// SQLite online backup API while the server keeps running. Copies go to
+// "<snapshotDir>/metadata-YYYYMMDD-HHMMSS-NNNNNN.db" via a ".partial" file
+// that is renamed once complete, so a snapshot on disk is always a full one.
+// The sequence number keeps snapshots taken within one second apart.
+class MetadataSnapshotter {
+public:
+    explicit MetadataSnapshotter(const SnapshotOptions& options);
+    ~MetadataSnapshotter();
+
+    void start();       // starts the scheduling thread if intervalMinutes > 0
+    void stop();        // aborts an in-progress copy and joins the thread
+
+    bool snapshotNow(std::string* snapshotPath = nullptr);
+
+private:
+    void run();
+    void pruneOldSnapshots();
+
+    SnapshotOptions options_;
+    std::thread thread_;
+    std::atomic<bool> running_{ false };
+    std::atomic<bool> stopRequested_{ false };
+    std::atomic<uint64_t> snapshotSeq_{ 0 };
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+// Append-only segment files for small uploads, "<storage>/packs/<n>.pack".
+// A packed file is the range [offset, offset + size) of one segment, recorded
+// in files.storage_path and files.pack_offset, so millions of tiny uploads
+// cost a few large files instead of an inode and a directory entry each.
+// Segments are never rewritten: a replaced file leaves its bytes behind as
+// dead space.
+class PackStore {
+public:
+    static constexpr const char* PACK_DIR = "packs";
+    static const uint64_t DEFAULT_SEGMENT_BYTES = 256ULL * 1024 * 1024;
+
+    struct Location {
+        std::string relativePath;   // segment, relative to the storage root
+        uint64_t offset = 0;
+    };
+
+    PackStore() = default;
+    ~PackStore();
+    PackStore(const PackStore&) = delete;
+    PackStore& operator=(const PackStore&) = delete;
+
+    // Continues appending to the newest segment under storageDir.
+    bool open(const std::string& storageDir);
+    void configure(uint64_t segmentBytes);
+
+    // Appends data to the current segment, starting a new one once it would
+    // pass the segment size. Appends are serialized; the caller syncs the
+    // segment (see UploadCommitter::syncAppended) before recording it.
+    bool append(const char* data, size_t length, Location& location);
+
+    // False if open() failed or a new segment could not be started; small
+    // uploads are then stored like any other.
+    bool isOpen() const;
+    void close();
+
+private:
+    bool openSegment(uint32_t id);
+    static std::string segmentName(uint32_t id);
+
+    mutable std::mutex mutex_;
+    std::string storageDir_;
+    uint64_t segmentBytes_ = DEFAULT_SEGMENT_BYTES;
+    uint32_t segmentId_ = 0;
+    uint64_t segmentEnd_ = 0;
+    int fd_ = -1;
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+// Bytes promised to uploads that are still in flight, per user. Committed
+// usage lives in the metadata database (user_usage); an upload is admitted
+// only if committed + in flight + its own size fits the user's quota, so
+// parallel uploads from one client cannot overshoot it together.
+class QuotaLedger {
+public:
+    class Reservation {
+    public:
+        Reservation() = default;
+        Reservation(Reservation&& other) noexcept
+            : ledger_(other.ledger_), user_(std::move(other.user_)), bytes_(other.bytes_) { other.ledger_ = nullptr; }
+        Reservation(const Reservation&) = delete;
+        Reservation& operator=(const Reservation&) = delete;
+        Reservation& operator=(Reservation&&) = delete;
+        ~Reservation() { if (ledger_) ledger_->release(user_, bytes_); }
+
+        explicit operator bool() const { return ledger_ != nullptr; }
+
+    private:
+        friend class QuotaLedger;
+        Reservation(QuotaLedger* ledger, std::string user, uint64_t bytes)
+            : ledger_(ledger), user_(std::move(user)), bytes_(bytes) {}
+
+        QuotaLedger* ledger_ = nullptr;
+        std::string user_;
+        uint64_t bytes_ = 0;
+    };
+
+    // committedBytes is called under the ledger lock, so an upload that
+    // commits and releases its reservation meanwhile is never missed.
+    // limit 0 = unlimited. Returns an empty reservation if over quota;
+    // `projected` is set to the usage the upload would have reached.
+    Reservation reserve(const std::string& user, uint64_t bytes, uint64_t limit,
+        const std::function<uint64_t()>& committedBytes, uint64_t& projected);
+    // Bytes the reservation could grow to and still fit limit (UINT64_MAX
+    // if unlimited); bounds output whose size is only known as it is made.
+    uint64_t headroom(const Reservation& reservation, uint64_t limit,
+        const std::function<uint64_t()>& committedBytes);
+    // Re-admits the reservation at a new size, such as the decompressed size
+    // of an upload admitted by its compressed length. On refusal it keeps
+    // its old size and `projected` is set as for reserve().
+    bool resize(Reservation& reservation, uint64_t bytes, uint64_t limit,
+        const std::function<uint64_t()>& committedBytes, uint64_t& projected);
+
+private:
+    void release(const std::string& user, uint64_t bytes);
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, uint64_t> reserved_;
+};
@@ -3,8 +3,27 @@
 #include <string>
 #include <thread>
 #include <atomic>
-#include <winsock2.h>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#include <unordered_set>
+#include <filesystem>
+#include "SocketCompat.hpp"
 #include <nlohmann/json.hpp>
+#include "MetadataSnapshotter.hpp"
+#include "WorkerPool.hpp"
+#include "TaskScheduler.hpp"
+#include "ServerConfig.hpp"
+#include "BandwidthShaper.hpp"
+#include "TransferScheduler.hpp"
+#include "QuotaLedger.hpp"
+#include "UploadCommitter.hpp"
+#include "PackStore.hpp"
+#include "HotFileCache.hpp"
+#include "CompressedVariants.hpp"
+#include "MetadataManager.hpp"
+#include "CommandParser.hpp"
 
 using json = nlohmann::json;
 
@@ -12,12 +31,21 @@ class ServerApp : public QObject
 {
     Q_OBJECT
 public:
+    static const size_t DEFAULT_LIST_PAGE_SIZE = 100;
+    static const int RETENTION_BATCH_PAUSE_MS = 50;
+    static const int CONFIG_POLL_SECONDS = 2;
+    static const size_t POSSESSION_PROOF_BYTES = 64 * 1024;   // range hashed for an UPLOADREF challenge
+
     explicit ServerApp(QObject* parent = nullptr);
     ServerApp(const std::string& configPath) : configPath_(configPath) {}
     ~ServerApp();
 
-    bool start();   // called when thread starts
-    void stop();
+    bool start();   // called when thread starts; returns once the server has drained
+    void stop();    // stop accepting; start() then drains in-flight transfers and returns
+
+    // Re-reads the config file on the watcher thread. Also triggered by a
+    // change of the file's modification time and, where available, SIGHUP.
+    void requestConfigReload();
 
 signals:
     void logMessage(const QString& msg);   // for UI logs
@@ -27,11 +55,87 @@ signals:
 
 private:
     bool loadConfig();
+    bool reloadConfig();
+    bool readConfigFile(json& cfg);
+    void applyConfig(const json& cfg);
+    std::shared_ptr<const ServerConfig> currentConfig() const;
+    void configWatchLoop();
     void handleClient(SOCKET clientSocket);
+    void handleUploadRef(SOCKET clientSocket, MetadataManager& metadataDB, const ServerConfig& config,
+        const CommandParser& parser);
+    void receivePacked(SOCKET clientSocket, MetadataManager& metadataDB, const std::string& fileName,
+        const std::string& uploader, size_t fileSize, std::string_view payload);
+    void handleDownload(SOCKET clientSocket, MetadataManager& metadataDB, const ServerConfig& config,
+        const CommandParser& parser);
+    bool sendRange(SOCKET clientSocket, const std::string& path, uint64_t offset, uint64_t length,
+        size_t chunkBytes, TransferClass transferClass, BandwidthShaper::Session& shaping);
+    bool sendBuffer(SOCKET clientSocket, const std::string& data, uint64_t offset, size_t chunkBytes,
+        TransferClass transferClass, BandwidthShaper::Session& shaping);
+    bool sendSlotted(SOCKET clientSocket, const char* data, size_t length, TransferClass transferClass);
+    void invalidateDerived(const std::string& fileName);
+    HotFileCache::Data loadVariant(const std::string& path, uint64_t start, uint64_t size, HotVariant variant);
+    QuotaLedger::Reservation admitUpload(SOCKET clientSocket, MetadataManager& metadataDB,
+        const ServerConfig& config, const std::string& fileName, const std::string& uploader, uint64_t size);
+    uint64_t committedUsage(MetadataManager& metadataDB, const std::string& fileName, const std::string& uploader);
+    void releaseReplaced(MetadataManager& metadataDB, const FileMetadata& previous, const std::string& newPath);
+    void rejectBusy(SOCKET clientSocket);
+    SOCKET openListener(bool reusePort);
+    void acceptLoop(SOCKET listener, int index);
+    bool beginConnection(SOCKET clientSocket);
+    void endConnection(SOCKET clientSocket);
+    void drainConnections();
+    void retentionLoop();
 
     std::atomic<bool> running_{ false };
     SOCKET serverSocket_ = INVALID_SOCKET;
     int serverPort_ = 2121;
     std::string storagePath_ = "storage";
     std::string configPath_ = "config/server_config.json";
+
+    // Accept threads. On Linux each gets its own SO_REUSEPORT listener and the
+    // kernel spreads new connections over them; elsewhere they share serverSocket_.
+    int acceptThreads_ = 1;
+    bool pinAcceptThreads_ = false;
+    std::vector<SOCKET> extraListeners_;
+    std::mutex listenersMutex_;
+
+    // Reloadable settings; read through currentConfig(), replaced whole by applyConfig().
+    std::shared_ptr<const ServerConfig> config_ = std::make_shared<ServerConfig>();
+    std::filesystem::file_time_type configWriteTime_{};
+    std::atomic<bool> reloadRequested_{ false };
+    std::thread configWatchThread_;
+
+    BandwidthShaper shaper_;                    // limits from ServerConfig::bandwidth
+    TransferScheduler transferScheduler_;       // interactive vs bulk disk I/O slots
+    TransferScheduler sendScheduler_;           // the same for socket sends, so slow clients never hold disk slots
+    QuotaLedger quotaLedger_;                   // upload bytes admitted but not yet committed
+    UploadCommitter committer_;                 // staging files and durable publish
+    std::mutex blobMutex_;                      // orders blob reuse against blob deletion
+    PackStore packStore_;                       // segment files holding small uploads
+    HotFileCache hotCache_;                     // popular small downloads, raw and gzipped
+    CompressedVariants variants_;               // gzipped copies kept for compressed downloads
+
+    // CPU-bound upload stages (decompression, checksums); 0 threads = one per core.
+    // Declared before workerPool_ so connection jobs are gone before it is destroyed.
+    int schedulerThreads_ = 0;
+    std::unique_ptr<TaskScheduler> scheduler_;
+    std::unique_ptr<WorkerPool> workerPool_;    // admission control, answers "BUSY <seconds>" when full
+
+    // Connections being served, so a drain can wait for them and, past
+    // "drainTimeoutSeconds", cut them off (uploads keep what they received).
+    std::unordered_multiset<SOCKET> activeConnections_;
+    bool forceClosing_ = false;
+    std::mutex connectionsMutex_;
+    std::condition_variable connectionsCv_;
+
+    // Download history retention, see ServerConfig
+    std::thread retentionThread_;
+
+    // Scheduled online snapshots of the metadata database
+    SnapshotOptions snapshotOptions_;
+    std::unique_ptr<MetadataSnapshotter> snapshotter_;
+
+    std::mutex maintenanceMutex_;
+    std::condition_variable maintenanceCv_;    // wakes background jobs on stop() and reloads
+    uint64_t configGeneration_ = 0;            // bumped by applyConfig(), under maintenanceMutex_
 };
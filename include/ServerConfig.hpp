@@ -0,0 +1,77 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include "Logger.hpp"
+#include "BandwidthShaper.hpp"
+#include "UploadCommitter.hpp"
+#include "PackStore.hpp"
+#include "HotFileCache.hpp"
+#include "CompressedVariants.hpp"
+
+// Server settings that can change while the server runs. ServerApp parses
+// each (re)load of server_config.json into a new immutable ServerConfig and
+// swaps the shared pointer atomically; a session loads the snapshot once and
+// passes it down, so a reload is never seen half-applied (RCU style). The
+// defaults match config/server_config.json, so a key left out of the file
+// behaves as shipped.
+struct ServerConfig {
+    static const int DEFAULT_MAX_CONCURRENT_TRANSFERS = 16;
+    static const int DEFAULT_TRANSFER_QUEUE_SIZE = 64;
+    static const int DEFAULT_DRAIN_TIMEOUT_SECONDS = 30;
+    static const size_t DEFAULT_UPLOAD_CHUNK_BYTES = 64 * 1024;
+    static const size_t MIN_UPLOAD_CHUNK_BYTES = 4 * 1024;
+    static const size_t MAX_UPLOAD_CHUNK_BYTES = 16 * 1024 * 1024;
+
+    size_t uploadChunkBytes = DEFAULT_UPLOAD_CHUNK_BYTES;
+    bool uploadPreallocate = true;          // reserve the declared size before receiving
+    FsyncPolicy fsyncPolicy = FsyncPolicy::PerFile;
+    int fsyncBatchMs = UploadCommitter::DEFAULT_BATCH_MS;
+    bool contentAddressed = true;           // store uploads as SHA-256 blobs, deduplicated
+    uint64_t packMaxFileBytes = 64 * 1024;  // uploads up to this size go into pack segments (0 = off)
+    uint64_t packSegmentBytes = PackStore::DEFAULT_SEGMENT_BYTES;
+    uint64_t hotCacheBytes = HotFileCache::DEFAULT_CAPACITY_BYTES;      // 0 = off
+    uint64_t hotCacheMaxFileBytes = HotFileCache::DEFAULT_MAX_FILE_BYTES;
+    int hotCacheMinDownloads = HotFileCache::DEFAULT_MIN_DOWNLOADS;
+    bool compressedVariants = true;         // keep the gzip made for a compressed download
+    uint64_t compressedVariantBytes = CompressedVariants::DEFAULT_CAPACITY_BYTES;
+    int compressedVariantMinDownloads = CompressedVariants::DEFAULT_MIN_DOWNLOADS;
+
+    int maxConcurrentTransfers = DEFAULT_MAX_CONCURRENT_TRANSFERS;
+    int transferQueueSize = DEFAULT_TRANSFER_QUEUE_SIZE;
+    int transferQueueTimeoutMs = 10000;
+    int busyRetryAfterSeconds = 5;
+    int drainTimeoutSeconds = DEFAULT_DRAIN_TIMEOUT_SECONDS;
+
+    BandwidthLimits bandwidth;
+
+    // Priority classes: uploads of at most interactiveMaxBytes, resumes and
+    // LIST/SEARCH are interactive, everything else bulk. ioSlots disk writes
+    // and sendSlots socket sends run at once, each shared by weight when
+    // contended. A send holds its slot only while the socket takes data.
+    uint64_t interactiveMaxBytes = 1024 * 1024;
+    int ioSlots = 4;
+    int sendSlots = 16;
+    int interactiveWeight = 8;
+    int bulkWeight = 1;
+
+    // Storage quota per uploader, checked before an upload writes anything
+    // (0 = unlimited). userQuotas overrides it for named users.
+    uint64_t userQuotaBytes = 0;
+    std::unordered_map<std::string, uint64_t> userQuotas;
+
+    uint64_t quotaFor(const std::string& user) const {
+        auto it = userQuotas.find(user);
+        return it == userQuotas.end() ? userQuotaBytes : it->second;
+    }
+
+    // Download history retention (0 days = keep raw rows forever)
+    int downloadRetentionDays = 0;
+    int retentionBatchSize = 500;
+    int retentionIntervalMinutes = 60;
+    int stagingMaxAgeHours = 72;            // unfinished uploads kept for resume (0 = forever)
+
+    LogLevel logLevel = LogLevel::Info;     // runtime filter on top of FTP_LITE_LOG_LEVEL
+    LogRotationPolicy logRotation{ 50ULL * 1024 * 1024, 24 * 60, 10, true };
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 (FIPS 180-4). Names blobs in the content-addressed store and
+// answers proof-of-possession challenges; kept in-tree so the server does
+// not need a crypto library for it.
+class Sha256 {
+public:
+    using Digest = std::array<uint8_t, 32>;
+
+    Sha256();
+
+    void update(const void* data, size_t length);
+    Digest finish();
+
+    static std::string toHex(const Digest& digest);
+
+    // Hash of `prefix` followed by `length` bytes of the file from `offset`
+    // (length = UINT64_MAX: to the end). Also computes the answer to a
+    // proof-of-possession challenge, where prefix is the server's nonce.
+    static bool hashFile(const std::string& path, const std::string& prefix, uint64_t offset, uint64_t length,
+        std::string& hex);
+
+private:
+    void compress(const uint8_t* block);
+
+    uint32_t state_[8];
+    uint8_t buffer_[64];
+    size_t buffered_ = 0;
+    uint64_t totalBytes_ = 0;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+// The Winsock names the networking code is written against, mapped onto BSD
+// sockets where Winsock does not exist.
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <cerrno>
+
+using SOCKET = int;
+using BOOL = int;
+using WORD = unsigned short;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#ifndef TRUE
+#define TRUE 1
+#endif
+#define SD_RECEIVE SHUT_RD
+#define SD_SEND SHUT_WR
+#define SD_BOTH SHUT_RDWR
+#define MAKEWORD(low, high) static_cast<WORD>(((low) & 0xff) | (((high) & 0xff) << 8))
+#define WSAEWOULDBLOCK EWOULDBLOCK
+#define WSAEINTR EINTR
+
+struct WSADATA {};
+using WSAPOLLFD = pollfd;
+
+inline int WSAStartup(WORD, WSADATA*) { return 0; }
+inline int WSACleanup() { return 0; }
+inline int closesocket(SOCKET socket) { return ::close(socket); }
+inline int WSAGetLastError() { return errno; }
+inline int WSAPoll(WSAPOLLFD* fds, unsigned long count, int timeout) { return ::poll(fds, count, timeout); }
+inline int ioctlsocket(SOCKET socket, long command, unsigned long* argument)
+{
+    int value = static_cast<int>(*argument);
+    return ::ioctl(socket, command, &value);
+}
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+struct FileMetadata;
+
+// Where stored files live under storagePath. New uploads go to a two-level
+// hashed fan-out, "<h0h1>/<h2h3>/<fileName>" (256 x 256 directories), so no
+// directory grows past a few dozen entries per million files. The relative
+// path is recorded in files.storage_path; rows without one predate the
+// layout and are still flat in storagePath (ftp_lite_storage_migrate moves them).
+class StorageLayout {
+public:
+    static std::string shardedPath(const std::string& fileName);
+    // Content-addressed blobs: "blobs/<h0h1>/<h2h3>/<sha256>".
+    static std::string blobPath(const std::string& contentHash);
+
+    // Absolute path of a stored file: its recorded storage_path, or the
+    // flat legacy location if none was recorded.
+    static std::string resolve(const std::string& storageRoot, const FileMetadata& meta);
+};
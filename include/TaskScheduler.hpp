@@ -0,0 +1,67 @@
+#pragma once
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Work-stealing pool for CPU-bound stages of a transfer (decompression,
+// checksums). One deque per worker: a worker pushes and pops its own tasks
+// at the back, idle workers steal from the front of the others. Tasks
+// submitted from outside the pool are spread round-robin.
+class TaskScheduler {
+public:
+    using Task = std::function<void()>;
+
+    explicit TaskScheduler(size_t threadCount = 0);     // 0 = one per hardware thread
+    ~TaskScheduler();
+
+    void submit(Task task);
+
+    // Runs one queued task on the calling thread; false if there was none.
+    bool runPendingTask();
+    bool isWorkerThread() const;
+    size_t threadCount() const { return threads_.size(); }
+
+    // Runs everything already queued, then joins the workers.
+    void shutdown();
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool popTask(size_t index, Task& task);
+    void runTask(Task& task);
+    void workerLoop(size_t index);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> nextQueue_{ 0 };
+    std::atomic<size_t> queued_{ 0 };
+    bool stopping_ = false;
+    std::mutex sleepMutex_;
+    std::condition_variable sleepCv_;
+};
+
+// Fork/join helper: run() tasks on a scheduler, wait() for all of them.
+// A scheduler worker that waits keeps executing queued tasks meanwhile, so
+// nested groups never deadlock the pool.
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskScheduler& scheduler) : scheduler_(scheduler) {}
+    ~TaskGroup() { wait(); }
+
+    void run(TaskScheduler::Task task);
+    void wait();
+
+private:
+    TaskScheduler& scheduler_;
+    size_t pending_ = 0;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
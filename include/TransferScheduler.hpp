@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+
+enum class TransferClass { Interactive = 0, Bulk = 1 };
+
+// Weighted fair queuing of I/O slots between transfer classes. A transfer
+// takes a slot around each disk access, or from a separate scheduler each
+// socket send, so a blocked send never holds up disk work; when slots are short,
+// waiters are granted in order of their virtual finish time
+// (start + bytes / weight), so interactive work gets `interactiveWeight`
+// times the share of bulk work without starving it.
+class TransferScheduler {
+public:
+    static const size_t CLASS_COUNT = 2;
+
+    class Slot {
+    public:
+        explicit Slot(TransferScheduler* owner) : owner_(owner) {}
+        Slot(Slot&& other) noexcept : owner_(other.owner_) { other.owner_ = nullptr; }
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+        Slot& operator=(Slot&&) = delete;
+        ~Slot() { if (owner_) owner_->release(); }
+    private:
+        TransferScheduler* owner_;
+    };
+
+    TransferScheduler(size_t slots = 4, unsigned interactiveWeight = 8, unsigned bulkWeight = 1);
+
+    void configure(size_t slots, unsigned interactiveWeight, unsigned bulkWeight);
+
+    // Blocks until a slot is free for this class; the slot is held until the
+    // returned object is destroyed.
+    Slot acquire(TransferClass cls, uint64_t bytes);
+
+private:
+    struct Waiter {
+        double finish;
+        uint64_t sequence;
+        bool operator>(const Waiter& other) const {
+            return finish != other.finish ? finish > other.finish : sequence > other.sequence;
+        }
+    };
+
+    void release();
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t slots_;
+    size_t inUse_ = 0;
+    double weights_[CLASS_COUNT];
+    double lastFinish_[CLASS_COUNT] = { 0, 0 };
+    double virtualTime_ = 0;
+    uint64_t nextSequence_ = 0;
+    std::priority_queue<Waiter, std::vector<Waiter>, std::greater<Waiter>> waiting_;
+};
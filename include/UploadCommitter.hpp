@@ -0,0 +1,104 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+#include <chrono>
+#include <cstdint>
+
+// How hard a committed upload is pushed to stable storage.
+enum class FsyncPolicy {
+    None,       // rename only; the OS writes data back when it likes
+    PerFile,    // fdatasync the file before the rename, fsync the directory after
+    Batched     // rename now; one background pass syncs everything committed in the last batch window
+};
+
+// Uploads are received into "<storage>/.incoming/<uploader>/<file>.part"
+// and renamed over the published name only once complete, so readers never
+// see a partial file and a failed overwrite leaves the old one intact. The
+// staging name is stable per (file, uploader) so an interrupted upload can
+// be resumed from another connection. The uploader's directory name is the
+// hex of the name, so no two uploaders share one whatever they are called.
+class UploadCommitter {
+public:
+    static constexpr const char* STAGING_DIR = ".incoming";
+    static const int DEFAULT_BATCH_MS = 200;
+
+    // Exclusive claim on a staging file; empty if another session is
+    // uploading the same file for the same user.
+    class Stage {
+    public:
+        Stage() = default;
+        Stage(Stage&& other) noexcept
+            : owner_(other.owner_), path_(std::move(other.path_)), synced_(other.synced_),
+              pendingDir_(std::move(other.pendingDir_)) { other.owner_ = nullptr; }
+        Stage(const Stage&) = delete;
+        Stage& operator=(const Stage&) = delete;
+        Stage& operator=(Stage&&) = delete;
+        ~Stage();
+
+        explicit operator bool() const { return owner_ != nullptr; }
+        const std::string& path() const { return path_; }
+
+    private:
+        friend class UploadCommitter;
+        Stage(UploadCommitter* owner, std::string path) : owner_(owner), path_(std::move(path)) {}
+
+        UploadCommitter* owner_ = nullptr;
+        std::string path_;
+        bool synced_ = false;           // prepare() already synced the data
+        std::string pendingDir_;        // directory sync left to finish()
+    };
+
+    UploadCommitter() = default;
+    ~UploadCommitter();
+
+    void configure(FsyncPolicy policy, int batchMs);
+
+    Stage stage(const std::string& storageDir, const std::string& fileName, const std::string& uploader);
+
+    // Syncs the staged data ahead of commit(), so a caller that commits
+    // under its own lock does not hold it through the fdatasync.
+    bool prepare(Stage& stage);
+    // Publishes the staged file as finalPath under the configured policy.
+    // After prepare(), the directory sync is left to finish().
+    bool commit(Stage& stage, const std::string& finalPath);
+    void finish(Stage& stage);
+    // Drops the staged data; used when the content is already stored.
+    void discard(const Stage& stage);
+    // Makes data appended to an existing file (a pack segment) durable
+    // under the configured policy, before the caller records it.
+    bool syncAppended(const std::string& path);
+
+    // Bytes of the uploader's unfinished uploads under storageDir, other
+    // than exceptFile and uploads in progress (their reservation covers
+    // them); they count against the uploader's quota.
+    uint64_t stagedBytes(const std::string& storageDir, const std::string& uploader,
+        const std::string& exceptFile) const;
+    // Deletes staging files no upload has touched for maxAge, such as
+    // uploads their clients never resumed. Returns how many were deleted.
+    int sweep(const std::string& storageDir, std::chrono::seconds maxAge);
+
+    // Syncs anything still waiting for a batch and stops the batch thread.
+    void shutdown();
+
+    static bool syncFile(const std::string& path);
+    static bool syncDirectory(const std::string& dir);
+
+private:
+    static std::string stagingDirFor(const std::string& storageDir, const std::string& uploader);
+    void release(const std::string& path);
+    void batchLoop();
+    void syncBatch(std::vector<std::string>& files);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    FsyncPolicy policy_ = FsyncPolicy::None;
+    int batchMs_ = DEFAULT_BATCH_MS;
+    std::unordered_set<std::string> staging_;
+    std::vector<std::string> pending_;      // committed, not yet synced (Batched)
+    std::thread batchThread_;
+    bool stopping_ = false;
+};
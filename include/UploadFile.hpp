@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Destination of an UPLOAD. Space for the declared size is reserved up
+// front (fallocate on Linux, the allocation size on Windows) without moving
+// end-of-file, so a partial upload still reports exactly the bytes received
+// for resume. Data is written at explicit offsets; whole zero blocks are
+// skipped rather than written, so sparse content keeps its holes (on NTFS
+// only once markSparse() has flagged the file).
+class UploadFile {
+public:
+    static const size_t BLOCK_SIZE = 4096;
+
+    enum class Allocation { Reserved, Unsupported, NoSpace, Failed };
+
+    UploadFile() = default;
+    ~UploadFile();
+    UploadFile(const UploadFile&) = delete;
+    UploadFile& operator=(const UploadFile&) = delete;
+
+    // Opens or creates the file and cuts it to `offset`: bytes past the
+    // client's resume offset were never confirmed.
+    bool open(const std::string& path, uint64_t offset);
+
+    // Reserves blocks for [offset, offset + length). On Unsupported or
+    // Failed the caller falls back to a free-space check.
+    Allocation preallocate(uint64_t offset, uint64_t length);
+
+    // Lets skipped ranges stay unallocated. POSIX file systems do this by
+    // default; NTFS fills them with written zeros unless the file is sparse.
+    bool markSparse();
+
+    bool writeAt(const char* data, size_t length, uint64_t offset);
+
+    // Sets the final size (restoring skipped trailing zeros and releasing
+    // reserved blocks past it) and closes the file.
+    bool finish(uint64_t size);
+
+    bool isOpen() const { return fd_ >= 0; }
+
+private:
+    bool writeRun(const char* data, size_t length, uint64_t offset);
+
+    int fd_ = -1;
+    uint64_t reservedEnd_ = 0;
+};
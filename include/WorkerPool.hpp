@@ -0,0 +1,59 @@
+#pragma once
+#include <functional>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// Fixed set of worker threads fed from a bounded FIFO queue. submit() never
+// blocks: when every worker is busy and the queue is full it returns false
+// and the caller turns the job away. A job that sits in the queue longer
+// than its timeout is not run: a reaper thread wakes at the earliest
+// deadline and calls its reject handler, even while every worker is busy.
+class WorkerPool {
+public:
+    using Job = std::function<void()>;
+
+    WorkerPool(size_t workerCount, size_t maxQueued);
+    ~WorkerPool();
+
+    bool submit(Job run, Job reject, std::chrono::milliseconds queueTimeout);
+
+    // Changes the limits while running. Extra workers start at once; surplus
+    // ones exit after finishing their current job.
+    void resize(size_t workerCount, size_t maxQueued);
+
+    // Stops accepting jobs and rejects everything still queued, leaving
+    // running jobs alone: the first step of a drain.
+    void closeQueue();
+    // Also joins the workers once their current jobs return.
+    void shutdown();
+
+    size_t activeCount() const;
+    size_t queuedCount() const;
+
+private:
+    struct QueuedJob {
+        Job run;
+        Job reject;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void workerLoop();
+    void reaperLoop();
+
+    size_t maxQueued_;
+    size_t targetWorkers_ = 0;
+    size_t liveWorkers_ = 0;
+    std::vector<std::thread> workers_;      // includes workers retired by resize(), joined on shutdown
+    std::thread reaper_;
+    std::deque<QueuedJob> queue_;
+    size_t active_ = 0;
+    bool stopping_ = false;
+    bool closed_ = false;                   // closeQueue() called
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable reaperCv_;      // new deadlines and shutdown
+};
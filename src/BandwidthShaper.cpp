@@ -0,0 +1,79 @@
+#include "BandwidthShaper.hpp"
+#include <algorithm>
+#include <thread>
+
+TokenBucket::TokenBucket(uint64_t bytesPerSecond)
+    : last_(std::chrono::steady_clock::now())
+{
+    setRate(bytesPerSecond);
+    tokens_ = burst_;           // a new bucket starts full
+}
+
+void TokenBucket::setRate(uint64_t bytesPerSecond)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    rate_ = static_cast<double>(bytesPerSecond);
+    burst_ = rate_ * BandwidthShaper::BURST_MS / 1000.0;
+    tokens_ = std::min(tokens_, burst_);
+}
+
+std::chrono::nanoseconds TokenBucket::consume(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rate_ <= 0) return std::chrono::nanoseconds(0);
+
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+
+    tokens_ = std::min(burst_, tokens_ + elapsed * rate_) - static_cast<double>(bytes);
+    if (tokens_ >= 0) return std::chrono::nanoseconds(0);
+    return std::chrono::nanoseconds(static_cast<int64_t>(-tokens_ / rate_ * 1e9));
+}
+
+void BandwidthShaper::Session::throttle(uint64_t bytes)
+{
+    auto wait = std::max({ global_->consume(bytes), user_->consume(bytes), session_->consume(bytes) });
+    if (wait >= std::chrono::microseconds(MIN_PAUSE_US))
+        std::this_thread::sleep_for(wait);
+}
+
+BandwidthShaper::BandwidthShaper()
+    : global_(std::make_shared<TokenBucket>())
+{
+}
+
+void BandwidthShaper::configure(const BandwidthLimits& limits)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    limits_ = limits;
+    global_->setRate(limits.globalBytesPerSecond);
+    for (auto& entry : users_)
+        if (auto bucket = entry.second.lock()) bucket->setRate(limits.perUserBytesPerSecond);
+    for (auto& weak : sessions_)
+        if (auto bucket = weak.lock()) bucket->setRate(limits.perSessionBytesPerSecond);
+}
+
+std::unique_ptr<BandwidthShaper::Session> BandwidthShaper::openSession(const std::string& user)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Drop entries whose sessions have all closed.
+    for (auto it = users_.begin(); it != users_.end();)
+        it = it->second.expired() ? users_.erase(it) : std::next(it);
+    sessions_.erase(std::remove_if(sessions_.begin(), sessions_.end(),
+        [](const std::weak_ptr<TokenBucket>& weak) { return weak.expired(); }), sessions_.end());
+
+    auto session = std::make_unique<Session>();
+    session->global_ = global_;
+
+    session->user_ = users_[user].lock();
+    if (!session->user_) {
+        session->user_ = std::make_shared<TokenBucket>(limits_.perUserBytesPerSecond);
+        users_[user] = session->user_;
+    }
+
+    session->session_ = std::make_shared<TokenBucket>(limits_.perSessionBytesPerSecond);
+    sessions_.push_back(session->session_);
+    return session;
+}
@@ -3,9 +3,13 @@
 #include "Logger.hpp"
 #include <fstream>
 #include <filesystem>
+#include <sstream>
+#include <thread>
+#include <chrono>
 #include "FileTransferEngine.hpp"
+#include "Sha256.hpp"
 #include <nlohmann/json.hpp>
-#include <winsock2.h>
+#include "SocketCompat.hpp"
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
@@ -66,14 +70,92 @@ bool ClientApp::uploadFile(const std::string& filePath, const std::string& usern
 
     long offset = getResumeOffset(filePath);
 
+    // Content the server already stores needs no transfer, if the server
+    // takes references and the file is big enough to be worth hashing. The
+    // server closes the connection after a refused UPLOADREF, so reconnect.
+    std::error_code ec;
+    uint64_t size = fs::file_size(filePath, ec);
+    if (!compress && offset == 0 && !ec && size >= REF_UPLOAD_MIN_BYTES && serverTakesReferences()) {
+        if (uploadByReference(filePath, username)) {
+            clearResumeData(filePath);
+            return true;
+        }
+        disconnect();
+        if (!connectToServer()) return false;
+    }
+    if (!connected_) return false;
+
     std::cout << "Uploading file: " << filePath << " compress=" << compress << std::endl;
-    bool success = engine.upload(filePath, clientSocket_, offset, username,
-        [&](double percent) {
-            Logger::info("Upload progress: " + std::to_string((int)percent) + "%");
-            saveResumeOffset(filePath, (long)((percent / 100.0) * fs::file_size(filePath)));
-        }, compress);
+    bool success = false;
+    for (int attempt = 0; ; ++attempt) {
+        success = engine.upload(filePath, clientSocket_, offset, username,
+            [&](double percent) {
+                LOG_EVENT_DEBUG(LogEvent::UploadProgress, filePath, (int)percent);
+                saveResumeOffset(filePath, (long)((percent / 100.0) * fs::file_size(filePath)));
+            }, compress);
+        if (success || engine.busyRetryAfter() == 0 || attempt == MAX_BUSY_RETRIES) break;
+        // Turned away before the server stored anything: resume where this attempt started.
+        saveResumeOffset(filePath, offset);
+        if (!waitAndReconnect(engine.busyRetryAfter())) return false;
+    }
     if(success)
         clearResumeData(filePath);
+    return success;
+}
+
+// The server closes a connection it turned away; wait as long as it asked
+// and connect again.
+bool ClientApp::waitAndReconnect(int seconds)
+{
+    Logger::info("Server busy, retrying in " + std::to_string(seconds) + "s");
+    disconnect();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    return connectToServer();
+}
+
+// Asks the server once, with CAPS, whether it takes UPLOADREF. The question
+// uses up the connection like any other command, so this reconnects; a
+// server too old to know CAPS closes without an answer and counts as no.
+bool ClientApp::serverTakesReferences()
+{
+    if (capsKnown_) return uploadRefs_;
+
+    FileTransferEngine engine;
+    std::string line;
+    uploadRefs_ = engine.sendAll(clientSocket_, "CAPS\n", 5) && recvLine(line) &&
+        (" " + line + " ").find(" uploadref ") != std::string::npos;
+    capsKnown_ = true;
+    disconnect();
+    return connectToServer() && uploadRefs_;
+}
+
+// Offers the file's SHA-256 to the server and, if it holds that content,
+// answers its possession challenge instead of sending the data.
+bool ClientApp::uploadByReference(const std::string& filePath, const std::string& username)
+{
+    std::string contentHash;
+    if (!Sha256::hashFile(filePath, "", 0, UINT64_MAX, contentHash)) return false;
+
+    FileTransferEngine engine;
+    std::string command = "UPLOADREF " + fs::path(filePath).filename().string() + " " + contentHash + " " +
+        std::to_string(fs::file_size(filePath)) + " " + username + "\n";
+    if (!engine.sendAll(clientSocket_, command.c_str(), command.size())) return false;
+
+    std::string line;
+    if (!recvLine(line) || line.rfind("CHALLENGE ", 0) != 0) return false;
+
+    std::istringstream challenge(line.substr(10));
+    std::string nonce;
+    uint64_t offset = 0, length = 0;
+    std::string proof;
+    if (!(challenge >> nonce >> offset >> length) ||
+        !Sha256::hashFile(filePath, nonce, offset, length, proof)) return false;
+
+    command = "PROOF " + proof + "\n";
+    if (!engine.sendAll(clientSocket_, command.c_str(), command.size())) return false;
+    if (!recvLine(line) || line != "OK") return false;
+
+    Logger::info("Uploaded by reference: " + filePath);
     return true;
 }
 
@@ -84,10 +166,15 @@ bool ClientApp::downloadFile(const std::string& fileName, const std::string& use
     FileTransferEngine engine;
     long offset = resume ? getResumeOffset(fileName) : 0;
 
-    bool success = engine.download(fileName, clientSocket_, offset, username,[&](double bytesReceived) {
-        // Server should send file size first  handle in your protocol
-        saveResumeOffset(fileName, (long)bytesReceived);
-        }, compress);
+    bool success = false;
+    for (int attempt = 0; ; ++attempt) {
+        success = engine.download(fileName, clientSocket_, offset, username,[&](double bytesReceived) {
+            LOG_EVENT_DEBUG(LogEvent::DownloadProgress, fileName, (long long)bytesReceived);
+            saveResumeOffset(fileName, (long)bytesReceived);
+            }, compress);
+        if (success || engine.busyRetryAfter() == 0 || attempt == MAX_BUSY_RETRIES) break;
+        if (!waitAndReconnect(engine.busyRetryAfter())) return false;
+    }
 
     if (success) clearResumeData(fileName);
     return success;
@@ -98,12 +185,95 @@ bool ClientApp::queryMetadata(const std::string& fileName) {
     return true;
 }
 
+bool ClientApp::listFiles(const std::string& cursor, size_t pageSize, const std::string& prefix,
+    std::vector<RemoteFileInfo>& files, std::string& nextCursor)
+{
+    if (!connected_) return false;
+    FileTransferEngine engine;
+
+    std::string command = "LIST " + std::to_string(pageSize) + " " + (cursor.empty() ? "-" : cursor);
+    if (!prefix.empty()) command += " " + prefix;
+    command += "\n";
+    if (!engine.sendAll(clientSocket_, command.c_str(), command.size())) {
+        Logger::error("Failed to send list command.");
+        return false;
+    }
+
+    if (!recvFileEntries(files, nextCursor)) {
+        Logger::error("Connection closed while listing files.");
+        return false;
+    }
+    if (nextCursor == "-") nextCursor.clear();
+    return true;
+}
+
+bool ClientApp::searchFiles(const std::string& query, size_t limit, std::vector<RemoteFileInfo>& files)
+{
+    if (!connected_ || query.empty()) return false;
+    FileTransferEngine engine;
+
+    std::string command = "SEARCH " + std::to_string(limit) + " " + query + "\n";
+    if (!engine.sendAll(clientSocket_, command.c_str(), command.size())) {
+        Logger::error("Failed to send search command.");
+        return false;
+    }
+
+    std::string trailer;
+    if (!recvFileEntries(files, trailer)) {
+        Logger::error("Connection closed while searching files.");
+        return false;
+    }
+    return true;
+}
+
+// Reads LIST/SEARCH result lines up to the "END <trailer>" line.
+bool ClientApp::recvFileEntries(std::vector<RemoteFileInfo>& files, std::string& trailer)
+{
+    std::string line;
+    while (recvLine(line)) {
+        if (line.rfind("END ", 0) == 0) {
+            trailer = line.substr(4);
+            return true;
+        }
+        if (line.rfind("BUSY ", 0) == 0) {
+            Logger::info("Server busy, retry after " + line.substr(5) + " seconds.");
+            return false;
+        }
+        if (line.rfind("ERR ", 0) == 0) {
+            Logger::error("Server rejected the request: " + line.substr(4));
+            return false;
+        }
+        std::istringstream iss(line);
+        RemoteFileInfo info;
+        iss >> info.fileName >> info.fileSize >> info.uploadTime >> info.uploader;
+        if (!info.fileName.empty()) files.push_back(std::move(info));
+    }
+    return false;
+}
+
+bool ClientApp::recvLine(std::string& line) {
+    for (;;) {
+        size_t pos = recvBuffer_.find('\n');
+        if (pos != std::string::npos) {
+            line = recvBuffer_.substr(0, pos);
+            recvBuffer_.erase(0, pos + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return true;
+        }
+        char chunk[4096];
+        int received = recv(clientSocket_, chunk, sizeof(chunk), 0);
+        if (received <= 0) return false;
+        recvBuffer_.append(chunk, received);
+    }
+}
+
 void ClientApp::disconnect() {
     if (connected_) {
         closesocket(clientSocket_);
         WSACleanup();
         connected_ = false;
     }    
+    recvBuffer_.clear();
     std::cout << "Disconnected." << std::endl;
 }
 
@@ -1,18 +1,43 @@
 #include "CommandParser.hpp"
-#include <sstream>
 
-CommandParser::CommandParser(const std::string& input) {
-    std::istringstream iss(input);
-    std::string token;
-    while (iss >> token)
-        tokens_.push_back(token);
+namespace {
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+}
+
+CommandParser::CommandParser(std::string_view input)
+    : input_(input)
+{
+    size_t pos = 0;
+    while (count_ < MAX_TOKENS) {
+        while (pos < input_.size() && isSpace(input_[pos])) ++pos;
+        if (pos == input_.size()) break;
+
+        size_t start = pos;
+        while (pos < input_.size() && !isSpace(input_[pos])) ++pos;
+        tokens_[count_++] = input_.substr(start, pos - start);
+    }
+
+    if (count_ > 0) type_ = lookup(tokens_[0]);
 }
 
-std::string CommandParser::getCommand() const {
-    return tokens_.empty() ? "" : tokens_[0];
+std::string_view CommandParser::getCommand() const {
+    return count_ ? tokens_[0] : std::string_view();
 }
 
-std::string CommandParser::getArg(size_t index) const {
-    if (index + 1 < tokens_.size()) return tokens_[index + 1];
-    return "";
+std::string_view CommandParser::getArg(size_t index) const {
+    if (index + 1 < count_) return tokens_[index + 1];
+    return std::string_view();
+}
+
+std::string_view CommandParser::getRest(size_t index) const {
+    std::string_view first = getArg(index);
+    if (first.empty()) return first;
+
+    std::string_view rest = input_.substr(static_cast<size_t>(first.data() - input_.data()));
+    while (!rest.empty() && isSpace(rest.back())) rest.remove_suffix(1);
+    return rest;
 }
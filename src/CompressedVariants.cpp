@@ -0,0 +1,176 @@
+#include "CompressedVariants.hpp"
+#include "HotFileCache.hpp"
+#include "StorageLayout.hpp"
+#include "Sha256.hpp"
+#include "Logger.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t VERSION_DIGITS = 16;
+
+}
+
+void CompressedVariants::open(const std::string& storageDir)
+{
+    struct Found {
+        fs::file_time_type written;
+        Entry entry;
+    };
+    std::vector<Found> found;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(fs::path(storageDir) / VARIANT_DIR, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) continue;
+        uint64_t size = it->file_size(ec);
+        // An empty file is what a crash between rename and writeback can leave.
+        if (ec || size == 0) {
+            fs::remove(it->path(), ec);
+            continue;
+        }
+        found.push_back({ it->last_write_time(ec), { it->path().string(), size } });
+    }
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.written > b.written; });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    storageDir_ = storageDir;
+    lru_.clear();
+    index_.clear();
+    bytes_ = 0;
+    for (auto& item : found) {
+        lru_.push_back(std::move(item.entry));
+        index_[lru_.back().path] = std::prev(lru_.end());
+        bytes_ += lru_.back().size;
+    }
+    evictLocked();
+}
+
+void CompressedVariants::configure(uint64_t capacityBytes, int minDownloads)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacityBytes_ = capacityBytes;
+    minDownloads_ = minDownloads;
+    evictLocked();
+}
+
+bool CompressedVariants::admits(const FileMetadata& meta) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacityBytes_ > 0 && meta.fileSize >= 0 && meta.downloadCount >= minDownloads_;
+}
+
+uint64_t CompressedVariants::bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+// "<storage>/.variants/<hh>/<hh>/<fileName>.<version hash>.gz"
+std::string CompressedVariants::pathFor(const FileMetadata& meta) const
+{
+    std::string version = HotFileCache::versionOf(meta);
+    Sha256 hash;
+    hash.update(version.data(), version.size());
+    return storageDir_ + "/" + VARIANT_DIR + "/" + StorageLayout::shardedPath(meta.fileName) + "." +
+        Sha256::toHex(hash.finish()).substr(0, VERSION_DIGITS) + ".gz";
+}
+
+CompressedVariants::Handle CompressedVariants::find(const FileMetadata& meta)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(pathFor(meta));
+    if (it == index_.end()) return Handle();
+    lru_.splice(lru_.begin(), lru_, it->second);
+    ++inUse_[it->first];
+    return Handle(this, it->first, it->second->size);
+}
+
+void CompressedVariants::release(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = inUse_.find(path);
+    if (it == inUse_.end() || --it->second > 0) return;
+    inUse_.erase(it);
+    if (doomed_.erase(path)) {
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+}
+
+bool CompressedVariants::publish(const std::string& compressedPath, const FileMetadata& meta)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string path = pathFor(meta);
+    std::error_code ec;
+    uint64_t size = fs::file_size(compressedPath, ec);
+    if (ec || capacityBytes_ == 0 || size > capacityBytes_) return false;
+
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    fs::rename(compressedPath, path, ec);
+    if (ec) {
+        Logger::error("[Server] Could not keep compressed variant of " + meta.fileName + ": " + ec.message());
+        return false;
+    }
+    // The same version gzips to the same bytes, so a download still holding
+    // the name now reads this file; it is no longer due for deletion.
+    doomed_.erase(path);
+
+    // A variant of an older version will never be asked for again.
+    removeVersionsLocked(meta.fileName, path);
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+        bytes_ -= it->second->size;
+        lru_.erase(it->second);
+    }
+    lru_.push_front({ path, size });
+    index_[path] = lru_.begin();
+    bytes_ += size;
+    evictLocked();
+    return true;
+}
+
+void CompressedVariants::invalidate(const std::string& fileName)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    removeVersionsLocked(fileName, std::string());
+}
+
+// Called with mutex_ held.
+void CompressedVariants::removeVersionsLocked(const std::string& fileName, const std::string& keep)
+{
+    fs::path dir = fs::path(storageDir_) / VARIANT_DIR / StorageLayout::shardedPath(fileName);
+    dir = dir.parent_path();
+    std::string prefix = fileName + ".";
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        std::string path = (dir / name).string();
+        if (name.size() == prefix.size() + VERSION_DIGITS + 3 && name.compare(0, prefix.size(), prefix) == 0 &&
+            name.compare(name.size() - 3, 3, ".gz") == 0 && path != keep)
+            removeLocked(path);
+    }
+}
+
+// Called with mutex_ held.
+void CompressedVariants::removeLocked(const std::string& path)
+{
+    std::error_code ec;
+    if (inUse_.count(path)) doomed_.insert(path);
+    else fs::remove(path, ec);
+    auto it = index_.find(path);
+    if (it == index_.end()) return;
+    bytes_ -= it->second->size;
+    lru_.erase(it->second);
+    index_.erase(it);
+}
+
+// Called with mutex_ held. A variant a download still holds is deleted
+// once it lets go; the next start re-indexes anything left behind.
+void CompressedVariants::evictLocked()
+{
+    while (bytes_ > capacityBytes_ && !lru_.empty())
+        removeLocked(lru_.back().path);
+}
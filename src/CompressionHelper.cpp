@@ -36,7 +36,38 @@ bool CompressionHelper::compressFile(const std::string& inputPath, const std::st
     return true;
 }
 
+bool CompressionHelper::compressBuffer(const char* data, size_t length, std::string& output) {
+    z_stream stream{};
+    // windowBits + 16 writes a gzip header and trailer, as gzopen does.
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        std::cerr << "[Compression] deflateInit2 failed." << std::endl;
+        return false;
+    }
+
+    output.resize(deflateBound(&stream, static_cast<uLong>(length)));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(length);
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        std::cerr << "[Compression] deflate failed." << std::endl;
+        return false;
+    }
+    return true;
+}
+
 bool CompressionHelper::decompressFile(const std::string& inputPath, const std::string& outputPath) {
+    bool overLimit = false;
+    return decompressFile(inputPath, outputPath, UINT64_MAX, overLimit);
+}
+
+bool CompressionHelper::decompressFile(const std::string& inputPath, const std::string& outputPath,
+    uint64_t maxOutput, bool& overLimit) {
+    overLimit = false;
     gzFile inFile = gzopen(inputPath.c_str(), "rb");
     if (!inFile) {
         std::cerr << "[Compression] Failed to open input file: " << inputPath << std::endl;
@@ -52,12 +83,30 @@ bool CompressionHelper::decompressFile(const std::string& inputPath, const std::
 
     std::vector<char> buffer(4096);
     int bytesRead;
+    uint64_t written = 0;
     while ((bytesRead = gzread(inFile, buffer.data(), static_cast<unsigned int>(buffer.size()))) > 0) {
-        outFile.write(buffer.data(), bytesRead);
+        if (static_cast<uint64_t>(bytesRead) > maxOutput - written) {
+            overLimit = true;
+            break;
+        }
+        if (!outFile.write(buffer.data(), bytesRead)) break;
+        written += static_cast<uint64_t>(bytesRead);
     }
 
+    // A corrupt or truncated stream ends the loop like end of file does;
+    // only gzerror tells them apart.
+    int error = Z_OK;
+    gzerror(inFile, &error);
     gzclose(inFile);
     outFile.close();
+    if (overLimit) {
+        std::cerr << "[Compression] " << inputPath << " inflates past " << maxOutput << " bytes." << std::endl;
+        return false;
+    }
+    if (bytesRead < 0 || error != Z_OK || !outFile) {
+        std::cerr << "[Compression] Failed to decompress: " << inputPath << std::endl;
+        return false;
+    }
     std::cout << "[Compression] Decompressed: " << inputPath << " → " << outputPath << std::endl;
     return true;
 }
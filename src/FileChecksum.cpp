@@ -0,0 +1,86 @@
+#include "FileChecksum.hpp"
+#include "TaskScheduler.hpp"
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+#include <filesystem>
+#include <cstdio>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool crc32Range(const std::string& path, uint64_t offset, uint64_t length, uint32_t& crc)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+    in.seekg(static_cast<std::streamoff>(offset));
+
+    std::vector<char> buffer(64 * 1024);
+    uLong value = ::crc32(0L, Z_NULL, 0);
+    while (length > 0) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(length, buffer.size()));
+        if (!in.read(buffer.data(), want)) return false;
+        value = ::crc32(value, reinterpret_cast<const Bytef*>(buffer.data()), static_cast<uInt>(want));
+        length -= want;
+    }
+    crc = static_cast<uint32_t>(value);
+    return true;
+}
+
+}
+
+uint32_t FileChecksum::crc32Buffer(const char* data, size_t length)
+{
+    uLong value = ::crc32(0L, Z_NULL, 0);
+    while (length > 0) {
+        uInt take = static_cast<uInt>(std::min<size_t>(length, 1u << 30));
+        value = ::crc32(value, reinterpret_cast<const Bytef*>(data), take);
+        data += take;
+        length -= take;
+    }
+    return static_cast<uint32_t>(value);
+}
+
+bool FileChecksum::crc32File(const std::string& path, TaskScheduler* scheduler, uint32_t& crc)
+{
+    std::error_code ec;
+    uint64_t size = fs::file_size(path, ec);
+    if (ec) return false;
+
+    size_t segments = static_cast<size_t>((size + SEGMENT_SIZE - 1) / SEGMENT_SIZE);
+    if (!scheduler || segments <= 1)
+        return crc32Range(path, 0, size, crc);
+
+    std::vector<uint32_t> partial(segments, 0);
+    std::atomic<bool> ok{ true };
+    {
+        TaskGroup group(*scheduler);
+        for (size_t i = 0; i < segments; ++i) {
+            group.run([&, i] {
+                uint64_t offset = static_cast<uint64_t>(i) * SEGMENT_SIZE;
+                uint64_t length = std::min<uint64_t>(SEGMENT_SIZE, size - offset);
+                if (!crc32Range(path, offset, length, partial[i])) ok = false;
+            });
+        }
+        group.wait();
+    }
+    if (!ok) return false;
+
+    uLong value = partial[0];
+    for (size_t i = 1; i < segments; ++i) {
+        uint64_t length = std::min<uint64_t>(SEGMENT_SIZE, size - static_cast<uint64_t>(i) * SEGMENT_SIZE);
+        value = crc32_combine(value, partial[i], static_cast<z_off_t>(length));
+    }
+    crc = static_cast<uint32_t>(value);
+    return true;
+}
+
+std::string FileChecksum::toHex(uint32_t crc)
+{
+    char text[9];
+    std::snprintf(text, sizeof(text), "%08x", static_cast<unsigned>(crc));
+    return text;
+}
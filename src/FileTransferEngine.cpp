@@ -4,13 +4,16 @@
 #include <fstream>
 #include <filesystem>
 #include <cstring>
-#include <winsock2.h>
+#include <cstdlib>
+#include <algorithm>
+#include "SocketCompat.hpp"
 
 namespace fs = std::filesystem;
 
 bool FileTransferEngine::upload(const std::string& filePath, int socket, long offset,
     const std::string& username, ProgressCallback progress, bool compress)
 {
+    busyRetryAfter_ = 0;
     if (!fs::exists(filePath)) {
         Logger::error("File not found: " + filePath);
         return false;
@@ -44,7 +47,7 @@ bool FileTransferEngine::upload(const std::string& filePath, int socket, long of
     }
 
     if (offset > 0 && offset < totalSize) {
-        Logger::info("Resuming upload from offset " + std::to_string(offset));
+        LOG_EVENT_INFO(LogEvent::UploadResumed, filePath, offset);
         file.seekg(offset);
     }
 
@@ -57,7 +60,12 @@ bool FileTransferEngine::upload(const std::string& filePath, int socket, long of
         if (bytesRead <= 0) break;
 
         if (!sendAll(socket, buffer, static_cast<size_t>(bytesRead))) {
-            Logger::error("Upload interrupted.");
+            // The server may have turned the upload away before reading it.
+            std::string reply;
+            if (recvReply(socket, reply) && reply.rfind("BUSY ", 0) == 0)
+                busyRetryAfter_ = std::max(1, std::atoi(reply.c_str() + 5));
+            else
+                Logger::error("Upload interrupted.");
             return false;
         }
 
@@ -65,6 +73,16 @@ bool FileTransferEngine::upload(const std::string& filePath, int socket, long of
         if (progress) progress((bytesSent * 100.0) / totalSize);
     }
 
+    // OK once the file is stored; BUSY, QUOTA, NOSPACE or ERR if it was refused.
+    std::string reply;
+    if (!recvReply(socket, reply) || reply != "OK") {
+        if (reply.rfind("BUSY ", 0) == 0)
+            busyRetryAfter_ = std::max(1, std::atoi(reply.c_str() + 5));
+        else
+            Logger::error("Upload refused: " + (reply.empty() ? std::string("no reply") : reply));
+        return false;
+    }
+
     Logger::info("Upload completed: " + filePath);
     return true;
 }
@@ -72,6 +90,7 @@ bool FileTransferEngine::upload(const std::string& filePath, int socket, long of
 bool FileTransferEngine::download(const std::string& fileName, int socket, long offset,
     const std::string& username, ProgressCallback progress, bool decompress)
 {
+    busyRetryAfter_ = 0;
 
     // Send DOWNLOAD command first
     std::string command = "DOWNLOAD " + fileName + " " + std::to_string(offset) + " " + username + " " + (decompress ? "1" : "0") + "\n";
@@ -81,6 +100,18 @@ bool FileTransferEngine::download(const std::string& fileName, int socket, long
         return false;
     }
 
+    // DATA <length> ahead of the bytes, or BUSY if the server is full.
+    std::string reply;
+    uint64_t length = 0;
+    if (!recvReply(socket, reply) || reply.rfind("DATA ", 0) != 0) {
+        if (reply.rfind("BUSY ", 0) == 0)
+            busyRetryAfter_ = std::max(1, std::atoi(reply.c_str() + 5));
+        else
+            Logger::error("Download refused: " + fileName);
+        return false;
+    }
+    length = std::strtoull(reply.c_str() + 5, nullptr, 10);
+
     const std::string tempPath = "downloads/temp_" + fileName;
 
     fs::create_directories("downloads");
@@ -100,19 +131,26 @@ bool FileTransferEngine::download(const std::string& fileName, int socket, long
     }
     char buffer[CHUNK_SIZE];
     long bytesReceived = offset;
+    uint64_t remaining = length;
 
-    while (true) {
-        int received = recv(socket, buffer, CHUNK_SIZE, 0);
+    while (remaining > 0) {
+        int received = recv(socket, buffer, static_cast<int>(std::min<uint64_t>(remaining, CHUNK_SIZE)), 0);
         if (received <= 0) break;
 
         file.write(buffer, received);
         bytesReceived += received;
+        remaining -= static_cast<uint64_t>(received);
 
         if (progress && bytesReceived % (CHUNK_SIZE * 2) == 0)
             progress((double)bytesReceived); // caller will compute %
     }
 
     file.close();
+    if (remaining > 0) {
+        Logger::error("Download interrupted: " + fileName);
+        if (progress) progress((double)bytesReceived);
+        return false;
+    }
     // Decompress if needed
     const std::string localPath = "downloads/" + fileName;
     if (decompress) {
@@ -143,6 +181,19 @@ bool FileTransferEngine::sendAll(int socket, const char* buffer, size_t length)
     return true;
 }
 
+// Reads one reply line a byte at a time, so nothing past it is consumed.
+bool FileTransferEngine::recvReply(int socket, std::string& line)
+{
+    line.clear();
+    char c;
+    while (line.size() < 256) {
+        if (recv(socket, &c, 1, 0) != 1) return false;
+        if (c == '\n') return true;
+        if (c != '\r') line += c;
+    }
+    return false;
+}
+
 bool FileTransferEngine::recvAll(int socket, char* buffer, size_t length)
 {
     size_t totalReceived = 0;
@@ -0,0 +1,98 @@
+#include "HotFileCache.hpp"
+#include <algorithm>
+
+void HotFileCache::configure(uint64_t capacityBytes, uint64_t maxFileBytes, int minDownloads)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacityBytes_ = capacityBytes;
+    maxFileBytes_ = maxFileBytes;
+    minDownloads_ = minDownloads;
+    evictTo(capacityBytes_);
+}
+
+bool HotFileCache::admits(const FileMetadata& meta) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacityBytes_ > 0 && meta.fileSize >= 0 &&
+        static_cast<uint64_t>(meta.fileSize) <= std::min(maxFileBytes_, capacityBytes_) &&
+        meta.downloadCount >= minDownloads_;
+}
+
+std::string HotFileCache::versionOf(const FileMetadata& meta)
+{
+    return meta.uploadTimestamp + "|" + std::to_string(meta.fileSize) + "|" + meta.checksum + "|" +
+        meta.storagePath + "|" + std::to_string(meta.packOffset);
+}
+
+std::string HotFileCache::keyOf(const std::string& fileName, HotVariant variant)
+{
+    return std::string(1, static_cast<char>('0' + static_cast<int>(variant))) + fileName;
+}
+
+HotFileCache::Data HotFileCache::get(const std::string& fileName, HotVariant variant, const std::string& version)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(keyOf(fileName, variant));
+    if (it == index_.end() || it->second->version != version) {
+        ++misses_;
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    ++hits_;
+    return it->second->data;
+}
+
+void HotFileCache::put(const std::string& fileName, HotVariant variant, const std::string& version, Data data)
+{
+    if (!data) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (data->size() > capacityBytes_) return;
+
+    std::string key = keyOf(fileName, variant);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        bytes_ -= it->second->data->size();
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+
+    bytes_ += data->size();
+    lru_.push_front(Entry{ key, version, std::move(data) });
+    index_[key] = lru_.begin();
+    evictTo(capacityBytes_);
+}
+
+void HotFileCache::invalidate(const std::string& fileName)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (HotVariant variant : { HotVariant::Raw, HotVariant::Gzip }) {
+        auto it = index_.find(keyOf(fileName, variant));
+        if (it == index_.end()) continue;
+        bytes_ -= it->second->data->size();
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+}
+
+void HotFileCache::evictTo(uint64_t capacityBytes)
+{
+    while (bytes_ > capacityBytes && !lru_.empty()) {
+        bytes_ -= lru_.back().data->size();
+        index_.erase(lru_.back().key);
+        lru_.pop_back();
+        ++evictions_;
+    }
+}
+
+HotFileCacheStats HotFileCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    HotFileCacheStats s;
+    s.hits = hits_.load();
+    s.misses = misses_.load();
+    s.evictions = evictions_.load();
+    s.bytes = bytes_;
+    s.capacityBytes = capacityBytes_;
+    s.entries = lru_.size();
+    return s;
+}
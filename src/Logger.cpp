@@ -1,14 +1,616 @@
 #include "Logger.hpp"
-#include <iostream>
+#include "CompressionHelper.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr size_t RING_CAPACITY = 64 * 1024;         // bytes per logging thread, power of two
+constexpr size_t RECORD_ALIGN = 16;
+constexpr size_t MAX_MESSAGE = RING_CAPACITY / 4;   // longer messages are truncated
+constexpr int IDLE_WAIT_MS = 20;                    // writer poll interval when idle
+
+enum RecordKind : uint16_t { RECORD_TEXT = 0, RECORD_WRAP = 1, RECORD_EVENT = 2 };
+
+struct RecordHeader {
+    uint64_t timestamp;     // nanoseconds since the Unix epoch
+    uint32_t length;        // payload bytes following the header
+    uint16_t level;
+    uint16_t kind;
+};
+static_assert(sizeof(RecordHeader) == RECORD_ALIGN, "record header must fill one alignment unit");
+
+// Date/time prefix of the last formatted second; strftime runs once per second.
+struct FormatCache {
+    std::time_t second = -1;
+    char prefix[32] = {};
+};
+
+size_t alignRecord(size_t n) { return (n + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1); }
+
+uint64_t nowNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+const char* levelTag(uint16_t level) {
+    switch (static_cast<LogLevel>(level)) {
+    case LogLevel::Debug: return "[DEBUG] ";
+    case LogLevel::Error: return "[ERROR] ";
+    default:              return "[INFO] ";
+    }
+}
+
+// Single-producer/single-consumer ring of variable-length records. The owning
+// thread pushes; only the writer thread drains. A record that does not fit
+// before the end of the buffer is preceded by a wrap marker and starts at 0.
+class RingBuffer {
+public:
+    bool tryPush(uint64_t timestamp, LogLevel level, RecordKind kind, const char* data, size_t length) {
+        const size_t need = alignRecord(sizeof(RecordHeader) + length);
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        const uint64_t tail = tail_.load(std::memory_order_acquire);
+
+        size_t pos = static_cast<size_t>(head & (RING_CAPACITY - 1));
+        const size_t contiguous = RING_CAPACITY - pos;
+        const size_t required = need <= contiguous ? need : contiguous + need;
+        if (RING_CAPACITY - (head - tail) < required) return false;
+
+        if (need > contiguous) {
+            RecordHeader wrap{ 0, 0, 0, RECORD_WRAP };
+            std::memcpy(data_ + pos, &wrap, sizeof(wrap));
+            head += contiguous;
+            pos = 0;
+        }
+
+        RecordHeader header{ timestamp, static_cast<uint32_t>(length), static_cast<uint16_t>(level), kind };
+        std::memcpy(data_ + pos, &header, sizeof(header));
+        std::memcpy(data_ + pos + sizeof(header), data, length);
+        head_.store(head + need, std::memory_order_release);
+        return true;
+    }
+
+    // Calls fn(header, payload) for every published record. Space is handed
+    // back to the producer only after the whole batch has been consumed.
+    template <typename Fn>
+    size_t drain(Fn&& fn) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        const uint64_t head = head_.load(std::memory_order_acquire);
+        size_t count = 0;
+        while (tail < head) {
+            const size_t pos = static_cast<size_t>(tail & (RING_CAPACITY - 1));
+            RecordHeader header;
+            std::memcpy(&header, data_ + pos, sizeof(header));
+            if (header.kind == RECORD_WRAP) {
+                tail += RING_CAPACITY - pos;
+                continue;
+            }
+            fn(header, data_ + pos + sizeof(header));
+            tail += alignRecord(sizeof(header) + header.length);
+            ++count;
+        }
+        tail_.store(tail, std::memory_order_release);
+        return count;
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+    std::atomic<bool> abandoned{ false };    // owning thread has exited
+
+private:
+    alignas(64) std::atomic<uint64_t> head_{ 0 };
+    alignas(64) std::atomic<uint64_t> tail_{ 0 };
+    alignas(64) char data_[RING_CAPACITY];
+};
+
+namespace fs = std::filesystem;
+
+// "logs/server.log" rotates to "logs/server.<stamp>.log"; its binary sibling
+// "logs/server.log.bin" to "logs/server.<stamp>.log.bin".
+std::string rotatedName(const std::string& activePath, const std::string& stamp) {
+    fs::path path(activePath);
+    return (path.parent_path() / (path.stem().string() + "." + stamp + path.extension().string())).string();
+}
+
+// Compresses and prunes rotated segments on its own thread, so neither the
+// logging threads nor the writer ever wait on gzip or directory scans.
+class SegmentArchiver {
+public:
+    SegmentArchiver() : thread_(&SegmentArchiver::run, this) {}
+    ~SegmentArchiver() { stop(); }
+
+    void submit(const std::string& activePath, std::vector<std::string> segments, bool compress, int keepFiles) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back({ activePath, std::move(segments), compress, keepFiles });
+        }
+        cv_.notify_one();
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) return;
+            stopping_ = true;
+        }
+        cv_.notify_one();
+        if (thread_.joinable()) thread_.join();
+    }
+
+private:
+    struct Job {
+        std::string activePath;
+        std::vector<std::string> segments;
+        bool compress;
+        int keepFiles;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty()) return;      // stopping with nothing left to do
+
+            Job job = std::move(jobs_.front());
+            jobs_.pop_front();
+            lock.unlock();
+
+            std::error_code ec;
+            if (job.compress) {
+                for (const auto& segment : job.segments) {
+                    if (CompressionHelper::compressFile(segment, segment + ".gz"))
+                        fs::remove(segment, ec);
+                }
+            }
+            prune(job.activePath, job.keepFiles);
+
+            lock.lock();
+        }
+    }
+
+    // Keeps the newest keepFiles text and binary segments; stamps sort chronologically.
+    static void prune(const std::string& activePath, int keepFiles) {
+        fs::path active(activePath);
+        const std::string prefix = active.stem().string() + ".";
+        const std::string textMarker = active.extension().string();
+        const std::string binaryMarker = textMarker + ".bin";
+
+        std::vector<fs::path> text, binary;
+        std::error_code ec;
+        fs::path dir = active.parent_path().empty() ? fs::path(".") : active.parent_path();
+        for (const auto& entry : fs::directory_iterator(dir, ec)) {
+            const std::string name = entry.path().filename().string();
+            if (name.rfind(prefix, 0) != 0 || entry.path() == active) continue;
+            if (name == active.filename().string() + ".bin") continue;
+            if (name.find(binaryMarker) != std::string::npos) binary.push_back(entry.path());
+            else if (name.find(textMarker) != std::string::npos) text.push_back(entry.path());
+        }
+
+        for (auto* group : { &text, &binary }) {
+            std::sort(group->begin(), group->end());
+            while (group->size() > static_cast<size_t>(std::max(keepFiles, 0))) {
+                fs::remove(group->front(), ec);
+                group->erase(group->begin());
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+class LogBackend {
+public:
+    LogBackend() : writer_(&LogBackend::run, this) {}
+    ~LogBackend() {
+        stop();
+        std::lock_guard<std::mutex> lock(sinkMutex_);
+        closeFilesLocked();
+    }
+
+    void log(LogLevel level, RecordKind kind, const char* message, size_t length) {
+        if (level < minLevel.load(std::memory_order_relaxed)) return;
+        if (length > MAX_MESSAGE) length = MAX_MESSAGE;
+        const uint64_t timestamp = nowNanos();
+
+        if (!running_) {
+            if (kind == RECORD_TEXT) writeDirect(timestamp, level, message, length);
+            return;
+        }
+
+        RingBuffer& ring = threadBuffer();
+        if (ring.tryPush(timestamp, level, kind, message, length)) return;
+
+        if (policy.load(std::memory_order_relaxed) == LogOverflowPolicy::Drop && level != LogLevel::Error) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        while (!ring.tryPush(timestamp, level, kind, message, length)) {
+            if (!running_) {
+                if (kind == RECORD_TEXT) writeDirect(timestamp, level, message, length);
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void open(const std::string& path) {
+        std::error_code ec;
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty()) std::filesystem::create_directories(parent, ec);
+
+        std::lock_guard<std::mutex> lock(sinkMutex_);
+        closeFilesLocked();
+        path_ = path;
+        openFilesLocked();
+    }
+
+    void setRotation(const LogRotationPolicy& policy) {
+        std::lock_guard<std::mutex> lock(sinkMutex_);
+        rotation_ = policy;
+    }
+
+    void flush() {
+        if (!running_) return;
+        std::unique_lock<std::mutex> lock(flushMutex_);
+        const uint64_t target = ++flushRequested_;
+        flushCv_.notify_all();
+        flushCv_.wait(lock, [&] { return flushCompleted_ >= target || !running_; });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(flushMutex_);
+            if (!running_) return;
+            running_ = false;
+        }
+        flushCv_.notify_all();
+        if (writer_.joinable()) writer_.join();
+        archiver_.stop();
+        // The files stay open for writeDirect() until the backend is destroyed.
+    }
+
+    std::atomic<LogOverflowPolicy> policy{ LogOverflowPolicy::Drop };
+    std::atomic<LogLevel> minLevel{ LogLevel::Debug };
+    std::atomic<bool> console{ true };
+    std::atomic<uint64_t> dropped{ 0 };
+
+private:
+    struct ThreadBufferHandle {
+        std::shared_ptr<RingBuffer> ring;
+        ~ThreadBufferHandle() { if (ring) ring->abandoned = true; }
+    };
+
+    RingBuffer& threadBuffer() {
+        thread_local ThreadBufferHandle handle;
+        if (!handle.ring) {
+            handle.ring = std::make_shared<RingBuffer>();
+            std::lock_guard<std::mutex> lock(registryMutex_);
+            buffers_.push_back(handle.ring);
+        }
+        return *handle.ring;
+    }
+
+    void run() {
+        std::vector<std::shared_ptr<RingBuffer>> buffers;
+        // One text buffer in logging order for the file; errorLines marks
+        // the [begin, end) of each error in it for the console's stderr.
+        std::string text, binary;
+        std::vector<std::pair<size_t, size_t>> errorLines;
+        FormatCache cache;
+        uint64_t droppedReported = 0;
+
+        for (;;) {
+            uint64_t requested;
+            {
+                std::lock_guard<std::mutex> lock(flushMutex_);
+                requested = flushRequested_;
+            }
+            const bool stopping = !running_;
+
+            {
+                std::lock_guard<std::mutex> lock(registryMutex_);
+                buffers = buffers_;
+            }
+
+            size_t drained = 0;
+            for (const auto& ring : buffers) {
+                drained += ring->drain([&](const RecordHeader& header, const char* payload) {
+                    if (header.kind == RECORD_EVENT) {
+                        appendBinary(binary, header, payload);
+                        return;
+                    }
+                    const size_t begin = text.size();
+                    appendFormatted(text, cache, header.timestamp, header.level, payload, header.length);
+                    if (header.level == static_cast<uint16_t>(LogLevel::Error)) errorLines.emplace_back(begin, text.size());
+                });
+            }
+
+            const uint64_t droppedNow = dropped.load(std::memory_order_relaxed);
+            if (droppedNow != droppedReported) {
+                std::string note = std::to_string(droppedNow - droppedReported) + " log records dropped (buffer full)";
+                const size_t begin = text.size();
+                appendFormatted(text, cache, nowNanos(), static_cast<uint16_t>(LogLevel::Error), note.data(), note.size());
+                errorLines.emplace_back(begin, text.size());
+                droppedReported = droppedNow;
+            }
+
+            writeBatch(text, errorLines, binary);
+            text.clear();
+            errorLines.clear();
+            binary.clear();
+
+            {
+                std::lock_guard<std::mutex> lock(registryMutex_);
+                for (auto it = buffers_.begin(); it != buffers_.end();) {
+                    if ((*it)->abandoned && (*it)->empty()) it = buffers_.erase(it);
+                    else ++it;
+                }
+            }
+            buffers.clear();
+
+            {
+                std::lock_guard<std::mutex> lock(flushMutex_);
+                flushCompleted_ = requested;
+            }
+            flushCv_.notify_all();
+
+            if (stopping) break;
+            if (drained == 0) {
+                std::unique_lock<std::mutex> lock(flushMutex_);
+                flushCv_.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MS),
+                    [&] { return flushRequested_ != requested || !running_; });
+            }
+        }
+    }
+
+    // Formatting happens here, on the writer thread, not at the call site.
+    static void appendFormatted(std::string& target, FormatCache& cache, uint64_t timestamp, uint16_t level,
+        const char* text, size_t length) {
+        const std::time_t seconds = static_cast<std::time_t>(timestamp / 1000000000ULL);
+        if (seconds != cache.second) {
+            std::tm tm{};
+#ifdef _WIN32
+            localtime_s(&tm, &seconds);
+#else
+            localtime_r(&seconds, &tm);
+#endif
+            std::strftime(cache.prefix, sizeof(cache.prefix), "%Y-%m-%d %H:%M:%S", &tm);
+            cache.second = seconds;
+        }
+        char millis[8];
+        std::snprintf(millis, sizeof(millis), ".%03u ", static_cast<unsigned>((timestamp / 1000000ULL) % 1000));
+
+        target += cache.prefix;
+        target += millis;
+        target += levelTag(level);
+        target.append(text, length);
+        target += '\n';
+    }
+
+    // Event payload is "u16 event id + arguments"; frame it with size, time and level.
+    static void appendBinary(std::string& target, const RecordHeader& header, const char* payload) {
+        const uint32_t size = static_cast<uint32_t>(sizeof(header.timestamp) + sizeof(header.level) + header.length);
+        target.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        target.append(reinterpret_cast<const char*>(&header.timestamp), sizeof(header.timestamp));
+        target.append(reinterpret_cast<const char*>(&header.level), sizeof(header.level));
+        target.append(payload, header.length);
+    }
+
+    void writeBatch(const std::string& text, const std::vector<std::pair<size_t, size_t>>& errorLines,
+        const std::string& binary) {
+        if (text.empty() && binary.empty()) return;
+        std::lock_guard<std::mutex> lock(sinkMutex_);
+        if (file_ && !text.empty()) {
+            std::fwrite(text.data(), 1, text.size(), file_);
+            std::fflush(file_);
+            fileBytes_ += text.size();
+        }
+        if (binaryFile_ && !binary.empty()) {
+            std::fwrite(binary.data(), 1, binary.size(), binaryFile_);
+            std::fflush(binaryFile_);
+            fileBytes_ += binary.size();
+        }
+        if (console) writeConsole(text, errorLines);
+
+        if (rotationDueLocked()) rotateLocked();
+    }
+
+    // Errors go to stderr, the rest to stdout, still in logging order.
+    static void writeConsole(const std::string& text, const std::vector<std::pair<size_t, size_t>>& errorLines) {
+        size_t position = 0;
+        for (const auto& [begin, end] : errorLines) {
+            std::fwrite(text.data() + position, 1, begin - position, stdout);
+            std::fflush(stdout);
+            std::fwrite(text.data() + begin, 1, end - begin, stderr);
+            position = end;
+        }
+        std::fwrite(text.data() + position, 1, text.size() - position, stdout);
+        std::fflush(stdout);
+    }
+
+    void openFilesLocked() {
+        std::error_code ec;
+        file_ = std::fopen(path_.c_str(), "ab");
+        fileBytes_ = file_ ? fs::file_size(path_, ec) : 0;
+        if (ec) fileBytes_ = 0;
+
+        // Structured events go to a sibling binary file; see LogEvents.hpp.
+        const std::string binaryPath = path_ + ".bin";
+        binaryFile_ = std::fopen(binaryPath.c_str(), "ab");
+        if (binaryFile_) {
+            // Only a file known to be empty gets the header: a size that
+            // cannot be read may still belong to a file that has one.
+            std::error_code sizeEc;
+            uintmax_t binarySize = fs::file_size(binaryPath, sizeEc);
+            if (sizeEc) {
+                binarySize = 0;
+            }
+            else if (binarySize == 0) {
+                std::fwrite(LOG_BINARY_MAGIC, 1, sizeof(LOG_BINARY_MAGIC), binaryFile_);
+                binarySize = sizeof(LOG_BINARY_MAGIC);
+            }
+            fileBytes_ += binarySize;
+        }
+        openedAt_ = std::chrono::steady_clock::now();
+    }
+
+    void closeFilesLocked() {
+        if (file_) std::fclose(file_);
+        if (binaryFile_) std::fclose(binaryFile_);
+        file_ = nullptr;
+        binaryFile_ = nullptr;
+    }
+
+    bool rotationDueLocked() const {
+        if (!file_) return false;
+        if (rotation_.maxBytes > 0 && fileBytes_ >= rotation_.maxBytes) return true;
+        return rotation_.maxAgeMinutes > 0 &&
+            std::chrono::steady_clock::now() - openedAt_ >= std::chrono::minutes(rotation_.maxAgeMinutes);
+    }
+
+    // Runs on the writer thread: close, rename and reopen are metadata-only;
+    // compression and pruning are handed to the archiver.
+    void rotateLocked() {
+        closeFilesLocked();
+
+        std::time_t now = std::time(nullptr);
+        std::tm tm{};
+#ifdef _WIN32
+        localtime_s(&tm, &now);
+#else
+        localtime_r(&now, &tm);
+#endif
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        char seq[16];
+        std::snprintf(seq, sizeof(seq), "-%06llu", static_cast<unsigned long long>(++rotationSeq_ % 1000000));
+        const std::string rotated = rotatedName(path_, std::string(stamp) + seq);
+
+        std::vector<std::string> segments;
+        std::error_code ec;
+        fs::rename(path_, rotated, ec);
+        if (!ec) segments.push_back(rotated);
+        fs::rename(path_ + ".bin", rotated + ".bin", ec);
+        if (!ec) segments.push_back(rotated + ".bin");
+
+        openFilesLocked();
+        archiver_.submit(path_, std::move(segments), rotation_.compress, rotation_.keepFiles);
+    }
+
+    // Used once the writer thread is gone (during and after shutdown), so
+    // late messages such as the windows' teardown still reach the file.
+    void writeDirect(uint64_t timestamp, LogLevel level, const char* message, size_t length) {
+        FormatCache cache;
+        std::string line;
+        appendFormatted(line, cache, timestamp, static_cast<uint16_t>(level), message, length);
+        std::lock_guard<std::mutex> lock(sinkMutex_);
+        if (file_) {
+            std::fwrite(line.data(), 1, line.size(), file_);
+            std::fflush(file_);
+            fileBytes_ += line.size();
+        }
+        if (console || !file_) {
+            std::fwrite(line.data(), 1, line.size(), level == LogLevel::Error ? stderr : stdout);
+            std::fflush(level == LogLevel::Error ? stderr : stdout);
+        }
+    }
+
+    std::mutex registryMutex_;
+    std::vector<std::shared_ptr<RingBuffer>> buffers_;
+
+    std::mutex sinkMutex_;
+    std::FILE* file_ = nullptr;
+    std::FILE* binaryFile_ = nullptr;
+    std::string path_;
+    uint64_t fileBytes_ = 0;                              // text + binary bytes in the active segment
+    std::chrono::steady_clock::time_point openedAt_;
+    LogRotationPolicy rotation_;
+    uint64_t rotationSeq_ = 0;
+    SegmentArchiver archiver_;
+
+    std::mutex flushMutex_;
+    std::condition_variable flushCv_;
+    uint64_t flushRequested_ = 0;
+    uint64_t flushCompleted_ = 0;
+    std::atomic<bool> running_{ true };
+
+    std::thread writer_;    // declared last: starts once everything above is constructed
+};
+
+LogBackend& backend() {
+    static LogBackend instance;
+    return instance;
+}
+
+}
 
 void Logger::init(const std::string& logFile) {
-    std::cout << "Initializing logger with file: " << logFile << std::endl;
+    backend().open(logFile);
+    info("Logging to file: " + logFile);
+}
+
+void Logger::debug(const std::string& message) {
+    backend().log(LogLevel::Debug, RECORD_TEXT, message.data(), message.size());
 }
 
 void Logger::info(const std::string& message) {
-    std::cout << "[INFO] " << message << std::endl;
+    backend().log(LogLevel::Info, RECORD_TEXT, message.data(), message.size());
 }
 
 void Logger::error(const std::string& message) {
-    std::cerr << "[ERROR] " << message << std::endl;
-}
\ No newline at end of file
+    backend().log(LogLevel::Error, RECORD_TEXT, message.data(), message.size());
+}
+
+void Logger::log(LogLevel level, const char* message, size_t length) {
+    backend().log(level, RECORD_TEXT, message, length);
+}
+
+void Logger::logEvent(LogLevel level, const char* record, size_t length) {
+    backend().log(level, RECORD_EVENT, record, length);
+}
+
+void Logger::setRotation(const LogRotationPolicy& policy) {
+    backend().setRotation(policy);
+}
+
+void Logger::setLevel(LogLevel level) {
+    backend().minLevel = level < LogLevel::Error ? level : LogLevel::Error;
+}
+
+void Logger::setOverflowPolicy(LogOverflowPolicy policy) {
+    backend().policy = policy;
+}
+
+void Logger::setConsoleOutput(bool enabled) {
+    backend().console = enabled;
+}
+
+uint64_t Logger::droppedCount() {
+    return backend().dropped.load();
+}
+
+void Logger::flush() {
+    backend().flush();
+}
+
+void Logger::shutdown() {
+    backend().stop();
+}
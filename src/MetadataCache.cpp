@@ -0,0 +1,113 @@
+#include "MetadataCache.hpp"
+
+MetadataCache::MetadataCache(size_t capacity)
+    : capacity_(capacity ? capacity : 1)
+{
+}
+
+std::shared_ptr<MetadataCache> MetadataCache::forDatabase(const std::string& dbPath) {
+    static std::mutex registryMutex;
+    static std::unordered_map<std::string, std::weak_ptr<MetadataCache>> registry;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto cache = registry[dbPath].lock();
+    if (!cache) {
+        cache = std::make_shared<MetadataCache>();
+        registry[dbPath] = cache;
+    }
+    return cache;
+}
+
+std::optional<FileMetadata> MetadataCache::get(const std::string& fileName) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(fileName);
+    if (it == index_.end()) {
+        ++misses_;
+        return std::nullopt;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    ++hits_;
+    return it->second->second;
+}
+
+void MetadataCache::put(const FileMetadata& meta, uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation < floor_) return;
+    auto stale = invalidatedAt_.find(meta.fileName);
+    if (stale != invalidatedAt_.end() && stale->second > generation) return;
+
+    auto it = index_.find(meta.fileName);
+    if (it != index_.end()) {
+        it->second->second = meta;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return;
+    }
+
+    lru_.emplace_front(meta.fileName, meta);
+    index_[meta.fileName] = lru_.begin();
+
+    while (lru_.size() > capacity_) {
+        index_.erase(lru_.back().first);
+        lru_.pop_back();
+        ++evictions_;
+    }
+}
+
+void MetadataCache::invalidate(const std::string& fileName) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t now = ++generation_;
+    if (invalidatedAt_.size() >= capacity_) {
+        invalidatedAt_.clear();
+        floor_ = now;
+    }
+    else {
+        invalidatedAt_[fileName] = now;
+    }
+
+    auto it = index_.find(fileName);
+    if (it == index_.end()) return;
+    lru_.erase(it->second);
+    index_.erase(it);
+}
+
+std::optional<std::vector<std::string>> MetadataCache::getFileNames() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!fileNames_) {
+        ++misses_;
+        return std::nullopt;
+    }
+    ++hits_;
+    return fileNames_;
+}
+
+void MetadataCache::putFileNames(std::vector<std::string> names, uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation < floor_ || fileNamesInvalidatedAt_ > generation) return;
+    fileNames_ = std::move(names);
+}
+
+void MetadataCache::invalidateFileNames() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fileNamesInvalidatedAt_ = ++generation_;
+    fileNames_.reset();
+}
+
+void MetadataCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    floor_ = ++generation_;
+    invalidatedAt_.clear();
+    lru_.clear();
+    index_.clear();
+    fileNames_.reset();
+}
+
+MetadataCacheStats MetadataCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MetadataCacheStats s;
+    s.hits = hits_.load();
+    s.misses = misses_.load();
+    s.evictions = evictions_.load();
+    s.size = lru_.size();
+    s.capacity = capacity_;
+    return s;
+}
@@ -1,10 +1,16 @@
 #include "MetadataManager.hpp"
+#include "MetadataCache.hpp"
 #include <iostream>
 #include <ctime>
+#include <sstream>
+#include <iomanip>
+#include <limits>
 #include "Logger.hpp"
 #include <filesystem>
 
-MetadataManager::MetadataManager(const std::string& dbPath) {
+MetadataManager::MetadataManager(const std::string& dbPath)
+    : cache_(MetadataCache::forDatabase(dbPath))
+{
     if (sqlite3_open(dbPath.c_str(), &db_) != SQLITE_OK) {
         Logger::info("[DB] Failed to open DB: " + std::string(sqlite3_errmsg(db_)));
         db_ = nullptr;
@@ -18,7 +24,59 @@ MetadataManager::~MetadataManager() {
     if (db_) sqlite3_close(db_);
 }
 
+namespace {
+
+// Converts the text timestamps written by schema v1: asctime() local time
+// from addFileRecord and datetime('now') UTC from updateFileMetadata.
+long long parseLegacyTimestamp(const std::string& text) {
+    std::tm tm{};
+    {
+        std::istringstream iss(text);
+        iss >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+        if (!iss.fail()) {
+#ifdef _WIN32
+            return static_cast<long long>(_mkgmtime(&tm));
+#else
+            return static_cast<long long>(timegm(&tm));
+#endif
+        }
+    }
+
+    tm = std::tm{};
+    std::istringstream iss(text);
+    iss >> std::get_time(&tm, "%a %b %d %H:%M:%S %Y");
+    if (!iss.fail()) {
+        tm.tm_isdst = -1;
+        return static_cast<long long>(std::mktime(&tm));
+    }
+    return 0;
+}
+
+// Reads "id, filename, size, upload_timestamp, uploader" from the current row.
+FileListEntry readFileListEntry(sqlite3_stmt* stmt) {
+    FileListEntry entry;
+    entry.id = sqlite3_column_int64(stmt, 0);
+    const unsigned char* fn = sqlite3_column_text(stmt, 1);
+    entry.fileName = fn ? reinterpret_cast<const char*>(fn) : "";
+    entry.fileSize = static_cast<long>(sqlite3_column_int64(stmt, 2));
+    entry.uploadTime = sqlite3_column_int64(stmt, 3);
+    const unsigned char* upl = sqlite3_column_text(stmt, 4);
+    entry.uploader = upl ? reinterpret_cast<const char*>(upl) : "";
+    return entry;
+}
+
+// Characters in a UTF-8 string: every byte that is not a continuation byte.
+size_t utf8Length(const std::string& text) {
+    size_t count = 0;
+    for (unsigned char c : text)
+        if ((c & 0xC0) != 0x80) ++count;
+    return count;
+}
+
+}
+
 void MetadataManager::initialize() {
+    // Version 1 layout; everything newer is applied by migrateSchema().
     const char* createTablesSQL = R"(
         CREATE TABLE IF NOT EXISTS files (
             id INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -38,24 +96,307 @@ void MetadataManager::initialize() {
         );
     )";
 
+    // Every client thread opens its own connection; wait for writers instead of failing.
+    sqlite3_busy_timeout(db_, 5000);
+    // WAL lets readers (the GUI, snapshots) run alongside upload commits.
+    execSQL("PRAGMA journal_mode = WAL;");
+
     char* errMsg = nullptr;
     if (sqlite3_exec(db_, createTablesSQL, nullptr, nullptr, &errMsg) != SQLITE_OK) {
         Logger::info(std::string("Error creating tables: ") + errMsg);
         sqlite3_free(errMsg);
+        return;
     }
-    else {
+
+    if (migrateSchema())
         Logger::info("[DB] Metadata tables ready.");
+}
+
+bool MetadataManager::execSQL(const char* sql) {
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db_, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        Logger::error(std::string("[DB] ") + (errMsg ? errMsg : sqlite3_errmsg(db_)));
+        sqlite3_free(errMsg);
+        return false;
     }
+    return true;
+}
+
+int MetadataManager::schemaVersion() {
+    int version = 0;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, "PRAGMA user_version;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            version = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    // Databases created before versioning report 0 but hold the v1 layout.
+    return version < 1 ? 1 : version;
+}
+
+bool MetadataManager::migrateSchema() {
+    if (schemaVersion() >= SCHEMA_VERSION) return true;
+
+    // IMMEDIATE so two connections opened at the same time don't both migrate.
+    if (!execSQL("BEGIN IMMEDIATE;")) return false;
+
+    int version = schemaVersion();
+    bool ok = true;
+    if (ok && version < 2) ok = migrateToV2();
+    if (ok && version < 3) ok = migrateToV3();
+    if (ok && version < 4) ok = migrateToV4();
+    if (ok && version < 5) ok = migrateToV5();
+    if (ok && version < 6) ok = migrateToV6();
+    if (ok && version < 7) ok = migrateToV7();
+    if (ok && version < 8) ok = migrateToV8();
+    if (ok && version < 9) ok = migrateToV9();
+    if (ok && version < 10) ok = migrateToV10();
+    if (ok && version < 11) ok = migrateToV11();
+
+    if (ok) {
+        std::string setVersion = "PRAGMA user_version = " + std::to_string(SCHEMA_VERSION) + ";";
+        ok = execSQL(setVersion.c_str());
+    }
+
+    if (!ok || !execSQL("COMMIT;")) {
+        execSQL("ROLLBACK;");
+        Logger::error("[DB] Schema migration from version " + std::to_string(version) + " failed.");
+        return false;
+    }
+
+    if (version < SCHEMA_VERSION)
+        Logger::info("[DB] Schema migrated from version " + std::to_string(version) +
+            " to " + std::to_string(SCHEMA_VERSION) + ".");
+    return true;
+}
+
+// v2: integer epoch timestamps (UTC seconds) and covering indexes for the
+// history and recent-files queries.
+bool MetadataManager::migrateToV2() {
+    const char* rebuildSQL = R"(
+        CREATE TABLE files_v2 (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            filename TEXT UNIQUE,
+            size INTEGER,
+            upload_timestamp INTEGER NOT NULL DEFAULT 0,
+            uploader TEXT,
+            download_count INTEGER DEFAULT 0
+        );
+        INSERT INTO files_v2 (id, filename, size, upload_timestamp, uploader, download_count)
+            SELECT id, filename, size, 0, uploader, download_count FROM files;
+
+        CREATE TABLE downloads_v2 (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            file_id INTEGER,
+            downloader TEXT,
+            timestamp INTEGER NOT NULL DEFAULT (strftime('%s', 'now')),
+            FOREIGN KEY (file_id) REFERENCES files (id)
+        );
+        INSERT INTO downloads_v2 (id, file_id, downloader, timestamp)
+            SELECT id, file_id, downloader, COALESCE(CAST(strftime('%s', timestamp) AS INTEGER), 0)
+            FROM downloads;
+    )";
+    if (!execSQL(rebuildSQL)) return false;
+
+    // Legacy upload timestamps come in two text formats; convert them here
+    // rather than in SQL since asctime() output has no SQLite parser.
+    sqlite3_stmt* select = nullptr;
+    sqlite3_stmt* update = nullptr;
+    if (sqlite3_prepare_v2(db_, "SELECT id, upload_timestamp FROM files WHERE upload_timestamp IS NOT NULL;",
+            -1, &select, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db_, "UPDATE files_v2 SET upload_timestamp = ? WHERE id = ?;",
+            -1, &update, nullptr) != SQLITE_OK) {
+        Logger::error("[DB] Migration prepare failed: " + std::string(sqlite3_errmsg(db_)));
+        sqlite3_finalize(select);
+        sqlite3_finalize(update);
+        return false;
+    }
+
+    bool ok = true;
+    while (ok && sqlite3_step(select) == SQLITE_ROW) {
+        const unsigned char* text = sqlite3_column_text(select, 1);
+        long long epoch = 0;
+        if (sqlite3_column_type(select, 1) == SQLITE_INTEGER)
+            epoch = sqlite3_column_int64(select, 1);
+        else if (text)
+            epoch = parseLegacyTimestamp(reinterpret_cast<const char*>(text));
+
+        sqlite3_bind_int64(update, 1, epoch);
+        sqlite3_bind_int64(update, 2, sqlite3_column_int64(select, 0));
+        ok = (sqlite3_step(update) == SQLITE_DONE);
+        sqlite3_reset(update);
+    }
+    sqlite3_finalize(select);
+    sqlite3_finalize(update);
+    if (!ok) return false;
+
+    const char* swapSQL = R"(
+        DROP TABLE files;
+        ALTER TABLE files_v2 RENAME TO files;
+        DROP TABLE downloads;
+        ALTER TABLE downloads_v2 RENAME TO downloads;
+
+        CREATE INDEX IF NOT EXISTS idx_downloads_file_ts ON downloads (file_id, timestamp, downloader);
+        CREATE INDEX IF NOT EXISTS idx_files_upload_ts ON files (upload_timestamp, filename);
+    )";
+    return execSQL(swapSQL);
+}
+
+// v3: index upload_timestamp alone so its implicit rowid suffix gives the
+// (upload_timestamp, id) order used for keyset pagination.
+bool MetadataManager::migrateToV3() {
+    return execSQL(R"(
+        DROP INDEX IF EXISTS idx_files_upload_ts;
+        CREATE INDEX idx_files_upload_ts ON files (upload_timestamp);
+    )");
+}
+
+// v4: external-content FTS5 index over files, kept in sync by triggers so
+// uploads maintain it incrementally. Trigram tokens give substring matches.
+bool MetadataManager::migrateToV4() {
+    return execSQL(R"(
+        CREATE VIRTUAL TABLE IF NOT EXISTS files_fts USING fts5(
+            filename, uploader,
+            content = 'files', content_rowid = 'id',
+            tokenize = 'trigram'
+        );
+
+        CREATE TRIGGER IF NOT EXISTS files_fts_ai AFTER INSERT ON files BEGIN
+            INSERT INTO files_fts (rowid, filename, uploader) VALUES (new.id, new.filename, new.uploader);
+        END;
+        CREATE TRIGGER IF NOT EXISTS files_fts_ad AFTER DELETE ON files BEGIN
+            INSERT INTO files_fts (files_fts, rowid, filename, uploader)
+                VALUES ('delete', old.id, old.filename, old.uploader);
+        END;
+        CREATE TRIGGER IF NOT EXISTS files_fts_au AFTER UPDATE OF filename, uploader ON files BEGIN
+            INSERT INTO files_fts (files_fts, rowid, filename, uploader)
+                VALUES ('delete', old.id, old.filename, old.uploader);
+            INSERT INTO files_fts (rowid, filename, uploader) VALUES (new.id, new.filename, new.uploader);
+        END;
+
+        INSERT INTO files_fts (files_fts) VALUES ('rebuild');
+    )");
+}
+
+// v5: per-file/per-user/per-day aggregates for compacted download history,
+// and a timestamp index so retention finds the oldest rows without a scan.
+bool MetadataManager::migrateToV5() {
+    return execSQL(R"(
+        CREATE TABLE IF NOT EXISTS download_rollups (
+            file_id INTEGER NOT NULL,
+            downloader TEXT NOT NULL,
+            day INTEGER NOT NULL,
+            download_count INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY (file_id, downloader, day),
+            FOREIGN KEY (file_id) REFERENCES files (id)
+        ) WITHOUT ROWID;
+
+        CREATE INDEX IF NOT EXISTS idx_downloads_timestamp ON downloads (timestamp);
+    )");
+}
+
+// v6: CRC32 of the stored content, computed once the upload is complete.
+bool MetadataManager::migrateToV6() {
+    return execSQL("ALTER TABLE files ADD COLUMN checksum TEXT;");
+}
+
+// v7: running storage totals per uploader for quota checks. Triggers update
+// them in the same statement (and so the same transaction) as the file row,
+// so admission reads one row instead of summing files.
+bool MetadataManager::migrateToV7() {
+    return execSQL(R"(
+        CREATE TABLE IF NOT EXISTS user_usage (
+            uploader TEXT PRIMARY KEY,
+            bytes_used INTEGER NOT NULL DEFAULT 0,
+            file_count INTEGER NOT NULL DEFAULT 0
+        ) WITHOUT ROWID;
+
+        INSERT OR REPLACE INTO user_usage (uploader, bytes_used, file_count)
+            SELECT COALESCE(uploader, ''), COALESCE(SUM(size), 0), COUNT(*)
+            FROM files GROUP BY COALESCE(uploader, '');
+
+        CREATE TRIGGER IF NOT EXISTS user_usage_ai AFTER INSERT ON files BEGIN
+            INSERT INTO user_usage (uploader, bytes_used, file_count)
+                VALUES (COALESCE(new.uploader, ''), COALESCE(new.size, 0), 1)
+                ON CONFLICT(uploader) DO UPDATE SET
+                    bytes_used = bytes_used + excluded.bytes_used,
+                    file_count = file_count + 1;
+        END;
+        CREATE TRIGGER IF NOT EXISTS user_usage_ad AFTER DELETE ON files BEGIN
+            UPDATE user_usage SET bytes_used = bytes_used - COALESCE(old.size, 0), file_count = file_count - 1
+                WHERE uploader = COALESCE(old.uploader, '');
+        END;
+        CREATE TRIGGER IF NOT EXISTS user_usage_au AFTER UPDATE OF size, uploader ON files BEGIN
+            UPDATE user_usage SET bytes_used = bytes_used - COALESCE(old.size, 0), file_count = file_count - 1
+                WHERE uploader = COALESCE(old.uploader, '');
+            INSERT INTO user_usage (uploader, bytes_used, file_count)
+                VALUES (COALESCE(new.uploader, ''), COALESCE(new.size, 0), 1)
+                ON CONFLICT(uploader) DO UPDATE SET
+                    bytes_used = bytes_used + excluded.bytes_used,
+                    file_count = file_count + 1;
+        END;
+    )");
+}
+
+// v8: location of the file under the storage root (see StorageLayout).
+// Existing rows keep NULL, meaning the flat layout, until migrated.
+bool MetadataManager::migrateToV8() {
+    return execSQL("ALTER TABLE files ADD COLUMN storage_path TEXT;");
+}
+
+// v10: small files packed into segment files (see PackStore). The file is
+// the size bytes at pack_offset in the segment named by storage_path.
+bool MetadataManager::migrateToV10() {
+    return execSQL("ALTER TABLE files ADD COLUMN pack_offset INTEGER;");
+}
+
+// v11: carry filename in the timestamp index so a prefix LIST can walk page
+// order and test names in the index, without reading or sorting rows.
+// id is spelled out so it still orders ties ahead of filename.
+bool MetadataManager::migrateToV11() {
+    return execSQL(R"(
+        DROP INDEX IF EXISTS idx_files_upload_ts;
+        CREATE INDEX idx_files_upload_ts ON files (upload_timestamp, id, filename);
+    )");
+}
+
+// v9: content-addressed blobs. files.content_hash names the blob a file
+// references; triggers keep blobs.refcount equal to the number of such files.
+bool MetadataManager::migrateToV9() {
+    return execSQL(R"(
+        CREATE TABLE IF NOT EXISTS blobs (
+            hash TEXT PRIMARY KEY,
+            size INTEGER NOT NULL,
+            checksum TEXT,
+            refcount INTEGER NOT NULL DEFAULT 0
+        ) WITHOUT ROWID;
+
+        ALTER TABLE files ADD COLUMN content_hash TEXT;
+
+        CREATE TRIGGER IF NOT EXISTS blobs_ref_ai AFTER INSERT ON files WHEN new.content_hash IS NOT NULL BEGIN
+            UPDATE blobs SET refcount = refcount + 1 WHERE hash = new.content_hash;
+        END;
+        CREATE TRIGGER IF NOT EXISTS blobs_ref_ad AFTER DELETE ON files WHEN old.content_hash IS NOT NULL BEGIN
+            UPDATE blobs SET refcount = refcount - 1 WHERE hash = old.content_hash;
+        END;
+        CREATE TRIGGER IF NOT EXISTS blobs_ref_au AFTER UPDATE OF content_hash ON files BEGIN
+            UPDATE blobs SET refcount = refcount - 1 WHERE hash = old.content_hash;
+            UPDATE blobs SET refcount = refcount + 1 WHERE hash = new.content_hash;
+        END;
+    )");
 }
 
 bool MetadataManager::addFileRecord(const std::string& filename, long filesize, const std::string& uploader) {
-    std::time_t now = std::time(nullptr);
-    std::string timestamp = std::asctime(std::localtime(&now));
-    timestamp.pop_back();
+    long long timestamp = static_cast<long long>(std::time(nullptr));
 
+    // Upsert rather than REPLACE so the row id (and its download history) survives.
     const char* sql = R"(
-        INSERT OR REPLACE INTO files (filename, size, upload_timestamp, uploader)
-        VALUES (?, ?, ?, ?);
+        INSERT INTO files (filename, size, upload_timestamp, uploader)
+        VALUES (?, ?, ?, ?)
+        ON CONFLICT(filename) DO UPDATE SET
+            size = excluded.size,
+            upload_timestamp = excluded.upload_timestamp,
+            uploader = excluded.uploader;
     )";
 
     sqlite3_stmt* stmt;
@@ -66,28 +407,38 @@ bool MetadataManager::addFileRecord(const std::string& filename, long filesize,
 
     sqlite3_bind_text(stmt, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int64(stmt, 2, filesize);
-    sqlite3_bind_text(stmt, 3, timestamp.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 3, timestamp);
     sqlite3_bind_text(stmt, 4, uploader.c_str(), -1, SQLITE_TRANSIENT);
 
     bool success = (sqlite3_step(stmt) == SQLITE_DONE);
     sqlite3_finalize(stmt);
 
-    if (success)
+    if (success) {
+        cache_->invalidate(filename);
+        cache_->invalidateFileNames();
         Logger::info("[DB] File record added/updated: " + filename);
+    }
 
     return success;
 }
 
-void MetadataManager::updateFileMetadata(const std::string& fileName, const std::string& uploader, long size) {
+void MetadataManager::updateFileMetadata(const std::string& fileName, const std::string& uploader, long size,
+    const std::string& checksum, const std::string& storagePath, const std::string& contentHash,
+    long long packOffset) {
     sqlite3_stmt* stmt = nullptr;
 
     const char* sql = R"(
-        INSERT INTO files (filename, uploader, size, upload_timestamp, download_count)
-        VALUES (?, ?, ?, datetime('now'), 0)
+        INSERT INTO files (filename, uploader, size, upload_timestamp, download_count, checksum, storage_path,
+            content_hash, pack_offset)
+        VALUES (?, ?, ?, ?, 0, ?, ?, ?, ?)
         ON CONFLICT(filename) DO UPDATE SET
             uploader = excluded.uploader,
             size = excluded.size,
-            upload_timestamp = excluded.upload_timestamp;
+            upload_timestamp = excluded.upload_timestamp,
+            checksum = excluded.checksum,
+            storage_path = excluded.storage_path,
+            content_hash = excluded.content_hash,
+            pack_offset = excluded.pack_offset;
     )";
 
     if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
@@ -95,20 +446,70 @@ void MetadataManager::updateFileMetadata(const std::string& fileName, const std:
         return;
     }
 
+    // The blob row must exist before the reference trigger counts it.
+    bool inTransaction = false;
+    if (!contentHash.empty()) {
+        inTransaction = execSQL("BEGIN IMMEDIATE;");
+        sqlite3_stmt* blob = nullptr;
+        if (sqlite3_prepare_v2(db_, "INSERT OR IGNORE INTO blobs (hash, size, checksum) VALUES (?, ?, ?);",
+                -1, &blob, nullptr) == SQLITE_OK) {
+            sqlite3_bind_text(blob, 1, contentHash.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(blob, 2, size);
+            if (checksum.empty()) sqlite3_bind_null(blob, 3);
+            else sqlite3_bind_text(blob, 3, checksum.c_str(), -1, SQLITE_STATIC);
+            sqlite3_step(blob);
+        }
+        sqlite3_finalize(blob);
+    }
+
     sqlite3_bind_text(stmt, 1, fileName.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, uploader.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int64(stmt, 3, size);
+    sqlite3_bind_int64(stmt, 4, static_cast<long long>(std::time(nullptr)));
+    if (checksum.empty()) sqlite3_bind_null(stmt, 5);
+    else sqlite3_bind_text(stmt, 5, checksum.c_str(), -1, SQLITE_STATIC);
+    if (storagePath.empty()) sqlite3_bind_null(stmt, 6);
+    else sqlite3_bind_text(stmt, 6, storagePath.c_str(), -1, SQLITE_STATIC);
+    if (contentHash.empty()) sqlite3_bind_null(stmt, 7);
+    else sqlite3_bind_text(stmt, 7, contentHash.c_str(), -1, SQLITE_STATIC);
+    if (packOffset < 0) sqlite3_bind_null(stmt, 8);
+    else sqlite3_bind_int64(stmt, 8, packOffset);
+
+    bool success = sqlite3_step(stmt) == SQLITE_DONE;
+    if (inTransaction && !execSQL(success ? "COMMIT;" : "ROLLBACK;")) {
+        execSQL("ROLLBACK;");
+        success = false;
+    }
 
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
+    if (!success) {
         Logger::info("Failed to execute insert/update: " + std::string(sqlite3_errmsg(db_)));
     }
     else {
+        cache_->invalidate(fileName);
+        cache_->invalidateFileNames();
         Logger::info("[DB] File metadata updated: " + fileName);
     }
 
     sqlite3_finalize(stmt);
 }
 
+bool MetadataManager::setStoragePath(const std::string& fileName, const std::string& storagePath) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, "UPDATE files SET storage_path = ? WHERE filename = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+        Logger::error("[DB] Prepare failed (storage path): " + std::string(sqlite3_errmsg(db_)));
+        return false;
+    }
+
+    if (storagePath.empty()) sqlite3_bind_null(stmt, 1);
+    else sqlite3_bind_text(stmt, 1, storagePath.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, fileName.c_str(), -1, SQLITE_TRANSIENT);
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+
+    if (success) cache_->invalidate(fileName);
+    return success;
+}
+
 bool MetadataManager::updateDownloadRecord(const std::string& filename, const std::string& downloader) {
     // Increment download count
     const char* sql1 = "UPDATE files SET download_count = download_count + 1 WHERE filename = ?;";
@@ -140,6 +541,9 @@ bool MetadataManager::updateDownloadRecord(const std::string& filename, const st
     bool success = (sqlite3_step(stmt2) == SQLITE_DONE);
     sqlite3_finalize(stmt2);
 
+    // download_count changed even if the history insert failed
+    cache_->invalidate(filename);
+
     if (success)
         Logger::info("[DB] Recorded download of " + filename + " by " + downloader);
 
@@ -173,9 +577,9 @@ std::tuple<long, std::string, std::string, int> MetadataManager::getFileMetadata
 std::vector<std::tuple<std::string, std::string>> MetadataManager::getDownloaders(const std::string& filename) {
     std::vector<std::tuple<std::string, std::string>> result;
     const char* sql = R"(
-        SELECT d.downloader, d.timestamp
-        FROM downloads d
-        JOIN files f ON f.id = d.file_id
+        SELECT d.downloader, datetime(d.timestamp, 'unixepoch', 'localtime')
+        FROM files f
+        JOIN downloads d ON d.file_id = f.id
         WHERE f.filename = ?
         ORDER BY d.timestamp DESC;
     )";
@@ -186,31 +590,317 @@ std::vector<std::tuple<std::string, std::string>> MetadataManager::getDownloader
     sqlite3_bind_text(stmt, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
 
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        std::string user = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        std::string time = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const unsigned char* userText = sqlite3_column_text(stmt, 0);
+        const unsigned char* timeText = sqlite3_column_text(stmt, 1);
+        std::string user = userText ? reinterpret_cast<const char*>(userText) : "";
+        std::string time = timeText ? reinterpret_cast<const char*>(timeText) : "";
         result.emplace_back(user, time);
     }
 
     sqlite3_finalize(stmt);
     return result;
 }
+
+std::vector<DownloadRollup> MetadataManager::getDownloadRollups(const std::string& filename) {
+    std::vector<DownloadRollup> result;
+    if (!db_) return result;
+
+    const char* sql = R"(
+        SELECT r.downloader, r.day, r.download_count
+        FROM files f
+        JOIN download_rollups r ON r.file_id = f.id
+        WHERE f.filename = ?
+        ORDER BY r.day DESC, r.downloader;
+    )";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return result;
+
+    sqlite3_bind_text(stmt, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        DownloadRollup rollup;
+        const unsigned char* user = sqlite3_column_text(stmt, 0);
+        rollup.downloader = user ? reinterpret_cast<const char*>(user) : "";
+        rollup.day = sqlite3_column_int64(stmt, 1);
+        rollup.downloadCount = sqlite3_column_int(stmt, 2);
+        result.push_back(std::move(rollup));
+    }
+
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+int MetadataManager::compactDownloadHistory(long long cutoff, int batchSize) {
+    if (!db_) return -1;
+    if (batchSize <= 0) batchSize = 1;
+
+    // Both statements pick the same rows: oldest first, ties broken by rowid.
+    const char* rollupSQL = R"(
+        INSERT INTO download_rollups (file_id, downloader, day, download_count)
+        SELECT file_id, COALESCE(downloader, ''), timestamp / 86400, COUNT(*)
+        FROM (
+            SELECT file_id, downloader, timestamp FROM downloads
+            WHERE timestamp < ?1
+            ORDER BY timestamp, id
+            LIMIT ?2
+        )
+        WHERE true
+        GROUP BY 1, 2, 3
+        ON CONFLICT (file_id, downloader, day) DO UPDATE SET
+            download_count = download_count + excluded.download_count;
+    )";
+    const char* deleteSQL = R"(
+        DELETE FROM downloads WHERE id IN (
+            SELECT id FROM downloads
+            WHERE timestamp < ?1
+            ORDER BY timestamp, id
+            LIMIT ?2
+        );
+    )";
+
+    if (!execSQL("BEGIN IMMEDIATE;")) return -1;
+
+    int compacted = -1;
+    sqlite3_stmt* rollup = nullptr;
+    sqlite3_stmt* remove = nullptr;
+    if (sqlite3_prepare_v2(db_, rollupSQL, -1, &rollup, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db_, deleteSQL, -1, &remove, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int64(rollup, 1, cutoff);
+        sqlite3_bind_int(rollup, 2, batchSize);
+        sqlite3_bind_int64(remove, 1, cutoff);
+        sqlite3_bind_int(remove, 2, batchSize);
+
+        if (sqlite3_step(rollup) == SQLITE_DONE && sqlite3_step(remove) == SQLITE_DONE)
+            compacted = sqlite3_changes(db_);
+    }
+    if (compacted < 0)
+        Logger::error("[DB] Download history compaction failed: " + std::string(sqlite3_errmsg(db_)));
+    sqlite3_finalize(rollup);
+    sqlite3_finalize(remove);
+
+    if (compacted < 0 || !execSQL("COMMIT;")) {
+        execSQL("ROLLBACK;");
+        return -1;
+    }
+    return compacted;
+}
 std::vector<std::string> MetadataManager::getAllFileNames() {
     std::vector<std::string> names;
     if (!db_) return names;
 
-    const char* sql = "SELECT filename FROM files ORDER BY upload_timestamp DESC;";
+    if (auto cached = cache_->getFileNames()) return *cached;
+    uint64_t generation = cache_->generation();
+
+    const char* sql = "SELECT filename FROM files ORDER BY upload_timestamp DESC, id DESC;";
     sqlite3_stmt* stmt = nullptr;
     if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
         sqlite3_free((char*)sqlite3_errmsg(db_));
         return names;
     }
 
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* text = sqlite3_column_text(stmt, 0);
+        if (text) names.emplace_back(reinterpret_cast<const char*>(text));
+    }
+    sqlite3_finalize(stmt);
+
+    cache_->putFileNames(names, generation);
+    return names;
+}
+
+std::vector<std::string> MetadataManager::getUnshardedFileNames() {
+    std::vector<std::string> names;
+    if (!db_) return names;
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, "SELECT filename FROM files WHERE storage_path IS NULL ORDER BY id;",
+            -1, &stmt, nullptr) != SQLITE_OK) {
+        Logger::error("[DB] Prepare failed (unsharded files): " + std::string(sqlite3_errmsg(db_)));
+        return names;
+    }
+
     while (sqlite3_step(stmt) == SQLITE_ROW) {
         const unsigned char* text = sqlite3_column_text(stmt, 0);
         if (text) names.emplace_back(reinterpret_cast<const char*>(text));
     }
     sqlite3_finalize(stmt);
     return names;
+}
+
+long long MetadataManager::countPrefixMatches(const std::string& prefix, const std::string& upper, long long limit) {
+    const char* sql = R"(
+        SELECT count(*) FROM (
+            SELECT 1 FROM files WHERE filename >= ?1 AND filename < ?2 LIMIT ?3
+        );
+    )";
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        Logger::error("[DB] Failed to prepare prefix count: " + std::string(sqlite3_errmsg(db_)));
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, prefix.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, upper.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 3, limit);
+
+    long long count = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+FileListPage MetadataManager::listFiles(const std::string& cursor, size_t pageSize, const std::string& prefix) {
+    FileListPage page;
+    if (!db_) return page;
+
+    if (pageSize == 0) pageSize = 1;
+    if (pageSize > MAX_PAGE_SIZE) pageSize = MAX_PAGE_SIZE;
+
+    // Cursor is "<upload_timestamp>:<id>" of the last row already returned.
+    // The first page starts above every real key, so the query is always a range seek.
+    long long cursorTime = std::numeric_limits<long long>::max();
+    long long cursorId = std::numeric_limits<long long>::max();
+    if (!cursor.empty()) {
+        size_t sep = cursor.find(':');
+        try {
+            if (sep == std::string::npos) throw std::invalid_argument("missing ':'");
+            cursorTime = std::stoll(cursor.substr(0, sep));
+            cursorId = std::stoll(cursor.substr(sep + 1));
+        }
+        catch (const std::exception&) {
+            Logger::error("[DB] Invalid list cursor: " + cursor);
+            page.invalidCursor = true;
+            return page;
+        }
+    }
+
+    // 0xFF never occurs in UTF-8, so prefix + 0xFF bounds every match.
+    std::string upper = prefix.empty() ? std::string() : prefix + '\xFF';
+
+    // Without a prefix the timestamp index serves the page directly. With
+    // one there are two plans: range-seek the unique filename index and sort
+    // the matches, or walk the timestamp index in page order and test the
+    // filename it carries (v11). The first costs every match per page, the
+    // second every row between matches, so sort only when the matches are few.
+    bool walkTimestamp = !prefix.empty() && countPrefixMatches(prefix, upper, PREFIX_SORT_LIMIT) >= PREFIX_SORT_LIMIT;
+
+    const char* sql = prefix.empty() ? R"(
+        SELECT id, filename, size, upload_timestamp, uploader
+        FROM files
+        WHERE (upload_timestamp, id) < (?1, ?2)
+        ORDER BY upload_timestamp DESC, id DESC
+        LIMIT ?4;
+    )" : walkTimestamp ? R"(
+        SELECT id, filename, size, upload_timestamp, uploader
+        FROM files INDEXED BY idx_files_upload_ts
+        WHERE (upload_timestamp, id) < (?1, ?2)
+          AND filename >= ?3 AND filename < ?5
+        ORDER BY upload_timestamp DESC, id DESC
+        LIMIT ?4;
+    )" : R"(
+        SELECT id, filename, size, upload_timestamp, uploader
+        FROM files
+        WHERE (upload_timestamp, id) < (?1, ?2)
+          AND filename >= ?3 AND filename < ?5
+        ORDER BY upload_timestamp DESC, id DESC
+        LIMIT ?4;
+    )";
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        Logger::error("[DB] Failed to prepare list statement: " + std::string(sqlite3_errmsg(db_)));
+        return page;
+    }
+
+    sqlite3_bind_int64(stmt, 1, cursorTime);
+    sqlite3_bind_int64(stmt, 2, cursorId);
+    if (!prefix.empty()) {
+        sqlite3_bind_text(stmt, 3, prefix.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 5, upper.c_str(), -1, SQLITE_TRANSIENT);
+    }
+    // Fetch one extra row to know whether another page exists.
+    sqlite3_bind_int64(stmt, 4, static_cast<long long>(pageSize) + 1);
+
+    page.entries.reserve(pageSize);
+    bool more = false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (page.entries.size() == pageSize) {
+            more = true;
+            break;
+        }
+        page.entries.push_back(readFileListEntry(stmt));
+    }
+    sqlite3_finalize(stmt);
+
+    if (more) {
+        const FileListEntry& last = page.entries.back();
+        page.nextCursor = std::to_string(last.uploadTime) + ":" + std::to_string(last.id);
+    }
+    return page;
+}
+
+std::vector<FileListEntry> MetadataManager::searchFiles(const std::string& query, size_t limit) {
+    std::vector<FileListEntry> results;
+    if (!db_) return results;
+
+    if (limit == 0) limit = 1;
+    if (limit > MAX_PAGE_SIZE) limit = MAX_PAGE_SIZE;
+
+    // Quote every term so user input can't inject FTS5 operators; terms are
+    // ANDed. Terms under 3 characters have no trigrams, so they are checked
+    // with instr() on the rows the other terms select. Either way a term is
+    // a case-insensitive substring of the filename or the uploader.
+    std::istringstream iss(query);
+    std::string term, matchExpr;
+    std::vector<std::string> shortTerms;
+    while (iss >> term) {
+        if (utf8Length(term) < 3) {
+            shortTerms.push_back(term);
+            continue;
+        }
+        std::string quoted = "\"";
+        for (char c : term) {
+            if (c == '"') quoted += '"';
+            quoted += c;
+        }
+        quoted += "\"";
+        if (!matchExpr.empty()) matchExpr += ' ';
+        matchExpr += quoted;
+    }
+    if (matchExpr.empty() && shortTerms.empty()) return results;
+
+    std::string filters;
+    for (size_t i = 0; i < shortTerms.size(); ++i)
+        filters += " AND instr(lower(f.filename || ' ' || f.uploader), lower(?" + std::to_string(i + 3) + ")) > 0";
+
+    // Filename hits outrank uploader hits. With only short terms there is
+    // nothing to rank by, so rows are tested in filename index order and the
+    // scan stops once limit rows match.
+    bool trigramUsable = !matchExpr.empty();
+    std::string sql = trigramUsable
+        ? "SELECT f.id, f.filename, f.size, f.upload_timestamp, f.uploader FROM files_fts "
+          "JOIN files f ON f.id = files_fts.rowid WHERE files_fts MATCH ?1" + filters +
+          " ORDER BY bm25(files_fts, 10.0, 1.0) LIMIT ?2;"
+        : "SELECT f.id, f.filename, f.size, f.upload_timestamp, f.uploader FROM files f "
+          "WHERE 1" + filters + " ORDER BY f.filename LIMIT ?2;";
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        Logger::error("[DB] Failed to prepare search statement: " + std::string(sqlite3_errmsg(db_)));
+        return results;
+    }
+    if (trigramUsable)
+        sqlite3_bind_text(stmt, 1, matchExpr.c_str(), -1, SQLITE_TRANSIENT);
+    for (size_t i = 0; i < shortTerms.size(); ++i)
+        sqlite3_bind_text(stmt, static_cast<int>(i + 3), shortTerms[i].c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 2, static_cast<long long>(limit));
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        results.push_back(readFileListEntry(stmt));
+    }
+    sqlite3_finalize(stmt);
+    return results;
 }/*
 FileMetadata MetadataManager::getFileMetadataRecord(const std::string& filename) {
     FileMetadata meta;
@@ -246,11 +936,23 @@ FileMetadata MetadataManager::getFileMetadataRecord(const std::string& filename)
     return meta;
 }*/
 FileMetadata MetadataManager::getFileMetadataRecord(const std::string& filename) {
+    if (!db_) return FileMetadata{};
+
+    if (auto cached = cache_->get(filename)) return *cached;
+    uint64_t generation = cache_->generation();
+
+    FileMetadata meta = loadFileMetadataRecord(filename);
+    if (!meta.fileName.empty())
+        cache_->put(meta, generation);
+    return meta;
+}
+
+FileMetadata MetadataManager::loadFileMetadataRecord(const std::string& filename) {
     FileMetadata meta;
-    if (!db_) return meta;
 
     const char* sql = R"(
-        SELECT filename, size, upload_timestamp, uploader, download_count
+        SELECT filename, size, datetime(upload_timestamp, 'unixepoch', 'localtime'), uploader, download_count,
+            checksum, storage_path, content_hash, pack_offset
         FROM files WHERE filename = ? LIMIT 1;
     )";
 
@@ -278,6 +980,13 @@ FileMetadata MetadataManager::getFileMetadataRecord(const std::string& filename)
         const unsigned char* upl = sqlite3_column_text(stmt, 3);
         meta.uploader = upl ? reinterpret_cast<const char*>(upl) : "";
         meta.downloadCount = sqlite3_column_int(stmt, 4);
+        const unsigned char* sum = sqlite3_column_text(stmt, 5);
+        meta.checksum = sum ? reinterpret_cast<const char*>(sum) : "";
+        const unsigned char* location = sqlite3_column_text(stmt, 6);
+        meta.storagePath = location ? reinterpret_cast<const char*>(location) : "";
+        const unsigned char* hash = sqlite3_column_text(stmt, 7);
+        meta.contentHash = hash ? reinterpret_cast<const char*>(hash) : "";
+        if (sqlite3_column_type(stmt, 8) != SQLITE_NULL) meta.packOffset = sqlite3_column_int64(stmt, 8);
     }
     else if (rc != SQLITE_DONE) {
         std::cerr << "[DB] Failed to step statement: " << sqlite3_errmsg(db_) << std::endl;
@@ -286,3 +995,66 @@ FileMetadata MetadataManager::getFileMetadataRecord(const std::string& filename)
     sqlite3_finalize(stmt);
     return meta;
 }
+
+UserUsage MetadataManager::getUserUsage(const std::string& uploader) {
+    UserUsage usage;
+    if (!db_) return usage;
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, "SELECT bytes_used, file_count FROM user_usage WHERE uploader = ?;",
+            -1, &stmt, nullptr) != SQLITE_OK) {
+        Logger::error("[DB] Usage query prepare failed: " + std::string(sqlite3_errmsg(db_)));
+        return usage;
+    }
+
+    sqlite3_bind_text(stmt, 1, uploader.c_str(), -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        usage.bytesUsed = sqlite3_column_int64(stmt, 0);
+        usage.fileCount = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    return usage;
+}
+
+BlobInfo MetadataManager::getBlob(const std::string& hash) {
+    BlobInfo blob;
+    if (!db_) return blob;
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, "SELECT size, refcount, checksum FROM blobs WHERE hash = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+        Logger::error("[DB] Blob query prepare failed: " + std::string(sqlite3_errmsg(db_)));
+        return blob;
+    }
+
+    sqlite3_bind_text(stmt, 1, hash.c_str(), -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        blob.hash = hash;
+        blob.size = sqlite3_column_int64(stmt, 0);
+        blob.refcount = sqlite3_column_int64(stmt, 1);
+        const unsigned char* sum = sqlite3_column_text(stmt, 2);
+        blob.checksum = sum ? reinterpret_cast<const char*>(sum) : "";
+    }
+    sqlite3_finalize(stmt);
+    return blob;
+}
+
+bool MetadataManager::dropBlobIfUnreferenced(const std::string& hash) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, "DELETE FROM blobs WHERE hash = ? AND refcount <= 0;", -1, &stmt, nullptr) != SQLITE_OK) {
+        Logger::error("[DB] Blob delete prepare failed: " + std::string(sqlite3_errmsg(db_)));
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, hash.c_str(), -1, SQLITE_TRANSIENT);
+    bool deleted = sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(db_) > 0;
+    sqlite3_finalize(stmt);
+    return deleted;
+}
+
+MetadataCacheStats MetadataManager::cacheStats() const {
+    return cache_->stats();
+}
+
+bool MetadataManager::checkpoint() {
+    return execSQL("PRAGMA wal_checkpoint(TRUNCATE);");
+}
@@ -0,0 +1,162 @@
+#include "MetadataSnapshotter.hpp"
+#include "Logger.hpp"
+#include <sqlite3.h>
+#include <filesystem>
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+
+namespace fs = std::filesystem;
+
+MetadataSnapshotter::MetadataSnapshotter(const SnapshotOptions& options)
+    : options_(options)
+{
+    if (options_.pagesPerStep <= 0) options_.pagesPerStep = 64;
+    if (options_.keepSnapshots <= 0) options_.keepSnapshots = 1;
+}
+
+MetadataSnapshotter::~MetadataSnapshotter()
+{
+    stop();
+}
+
+void MetadataSnapshotter::start()
+{
+    if (options_.intervalMinutes <= 0 || thread_.joinable()) return;
+    running_ = true;
+    stopRequested_ = false;
+    thread_ = std::thread(&MetadataSnapshotter::run, this);
+}
+
+void MetadataSnapshotter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        stopRequested_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+void MetadataSnapshotter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        cv_.wait_for(lock, std::chrono::minutes(options_.intervalMinutes), [this] { return !running_; });
+        if (!running_) break;
+
+        lock.unlock();
+        snapshotNow();
+        lock.lock();
+    }
+}
+
+bool MetadataSnapshotter::snapshotNow(std::string* snapshotPath)
+{
+    std::error_code ec;
+    fs::create_directories(options_.snapshotDir, ec);
+
+    std::time_t now = std::time(nullptr);
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &now);
+#else
+    localtime_r(&now, &tm);
+#endif
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    // The sequence restarts with the process; skip names an earlier run took.
+    std::string finalPath;
+    do {
+        char seq[16];
+        std::snprintf(seq, sizeof(seq), "-%06llu", static_cast<unsigned long long>(++snapshotSeq_ % 1000000));
+        finalPath = options_.snapshotDir + "/metadata-" + stamp + seq + ".db";
+    } while (fs::exists(finalPath, ec));
+    const std::string partialPath = finalPath + ".partial";
+    fs::remove(partialPath, ec);
+
+    sqlite3* src = nullptr;
+    sqlite3* dest = nullptr;
+    if (sqlite3_open_v2(options_.dbPath.c_str(), &src, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK ||
+        sqlite3_open(partialPath.c_str(), &dest) != SQLITE_OK) {
+        Logger::error("[Snapshot] Failed to open databases: " +
+            std::string(sqlite3_errmsg(dest ? dest : src)));
+        sqlite3_close(src);
+        sqlite3_close(dest);
+        return false;
+    }
+
+    sqlite3_backup* backup = sqlite3_backup_init(dest, "main", src, "main");
+    if (!backup) {
+        Logger::error("[Snapshot] Backup init failed: " + std::string(sqlite3_errmsg(dest)));
+        sqlite3_close(src);
+        sqlite3_close(dest);
+        return false;
+    }
+
+    // Copy a few pages at a time and release the read lock between steps.
+    // A write through another connection restarts the copy; after maxRestarts
+    // the remainder is copied in one step, which under WAL still lets writers
+    // proceed while we read.
+    int rc;
+    int restarts = 0;
+    int lastRemaining = -1;
+    int pagesPerStep = options_.pagesPerStep;
+    do {
+        rc = sqlite3_backup_step(backup, pagesPerStep);
+
+        int remaining = sqlite3_backup_remaining(backup);
+        if (lastRemaining >= 0 && remaining > lastRemaining && ++restarts >= options_.maxRestarts)
+            pagesPerStep = -1;
+        lastRemaining = remaining;
+
+        if (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            if (stopRequested_) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(options_.stepPauseMs));
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    sqlite3_backup_finish(backup);
+    bool ok = (rc == SQLITE_DONE);
+    if (!ok && rc != SQLITE_OK)
+        Logger::error("[Snapshot] Backup step failed: " + std::string(sqlite3_errstr(rc)));
+    sqlite3_close(src);
+    sqlite3_close(dest);
+
+    if (!ok) {
+        fs::remove(partialPath, ec);
+        return false;
+    }
+
+    fs::rename(partialPath, finalPath, ec);
+    if (ec) {
+        Logger::error("[Snapshot] Failed to finalize " + finalPath + ": " + ec.message());
+        return false;
+    }
+
+    Logger::info("[Snapshot] Metadata snapshot written: " + finalPath);
+    if (snapshotPath) *snapshotPath = finalPath;
+    pruneOldSnapshots();
+    return true;
+}
+
+void MetadataSnapshotter::pruneOldSnapshots()
+{
+    std::vector<fs::path> snapshots;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(options_.snapshotDir, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind("metadata-", 0) == 0 && entry.path().extension() == ".db")
+            snapshots.push_back(entry.path());
+    }
+
+    // Names embed the timestamp, so lexical order is chronological.
+    std::sort(snapshots.begin(), snapshots.end());
+    while (snapshots.size() > static_cast<size_t>(options_.keepSnapshots)) {
+        fs::remove(snapshots.front(), ec);
+        snapshots.erase(snapshots.begin());
+    }
+}
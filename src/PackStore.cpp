@@ -0,0 +1,135 @@
+#include "PackStore.hpp"
+#include "UploadCommitter.hpp"
+#include "Logger.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+PackStore::~PackStore()
+{
+    close();
+}
+
+std::string PackStore::segmentName(uint32_t id)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%08u.pack", id);
+    return std::string(PACK_DIR) + "/" + name;
+}
+
+bool PackStore::open(const std::string& storageDir)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    storageDir_ = storageDir;
+
+    std::error_code ec;
+    fs::path dir = fs::path(storageDir) / PACK_DIR;
+    fs::create_directories(dir, ec);
+
+    uint32_t newest = 1;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.path().extension() != ".pack") continue;
+        unsigned long id = std::strtoul(entry.path().stem().string().c_str(), nullptr, 10);
+        if (id > newest) newest = static_cast<uint32_t>(id);
+    }
+    return openSegment(newest);
+}
+
+void PackStore::configure(uint64_t segmentBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    segmentBytes_ = segmentBytes > 0 ? segmentBytes : DEFAULT_SEGMENT_BYTES;
+}
+
+// Called with mutex_ held.
+bool PackStore::openSegment(uint32_t id)
+{
+    if (fd_ >= 0) {
+#ifdef _WIN32
+        _close(fd_);
+#else
+        ::close(fd_);
+#endif
+        fd_ = -1;
+    }
+
+    std::string path = storageDir_ + "/" + segmentName(id);
+    std::error_code ec;
+    bool created = !fs::exists(path, ec);
+#ifdef _WIN32
+    fd_ = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+#endif
+    if (fd_ < 0) {
+        Logger::error("[Server] Cannot open pack segment " + path);
+        return false;
+    }
+
+    // Bytes past the last recorded entry are from an append that never
+    // reached the database; appending after them only wastes that space.
+    segmentId_ = id;
+    segmentEnd_ = fs::file_size(path, ec);
+    if (ec) segmentEnd_ = 0;
+    if (created) UploadCommitter::syncDirectory(fs::path(path).parent_path().string());
+    return true;
+}
+
+bool PackStore::append(const char* data, size_t length, Location& location)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) return false;
+    if (segmentEnd_ > 0 && segmentEnd_ + length > segmentBytes_ && !openSegment(segmentId_ + 1)) return false;
+
+    uint64_t offset = segmentEnd_;
+    size_t done = 0;
+    while (done < length) {
+#ifdef _WIN32
+        if (_lseeki64(fd_, static_cast<__int64>(offset + done), SEEK_SET) < 0) return false;
+        int written = _write(fd_, data + done, static_cast<unsigned>(length - done));
+#else
+        ssize_t written = ::pwrite(fd_, data + done, length - done, static_cast<off_t>(offset + done));
+        if (written < 0 && errno == EINTR) continue;
+#endif
+        if (written <= 0) {
+            // Leave the end where it was; the partial bytes are overwritten next time.
+            Logger::error("[Server] Append to pack segment " + segmentName(segmentId_) + " failed.");
+            return false;
+        }
+        done += static_cast<size_t>(written);
+    }
+
+    segmentEnd_ = offset + length;
+    location.relativePath = segmentName(segmentId_);
+    location.offset = offset;
+    return true;
+}
+
+bool PackStore::isOpen() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fd_ >= 0;
+}
+
+void PackStore::close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) return;
+#ifdef _WIN32
+    _close(fd_);
+#else
+    ::close(fd_);
+#endif
+    fd_ = -1;
+}
@@ -0,0 +1,50 @@
+#include "QuotaLedger.hpp"
+
+QuotaLedger::Reservation QuotaLedger::reserve(const std::string& user, uint64_t bytes, uint64_t limit,
+    const std::function<uint64_t()>& committedBytes, uint64_t& projected)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = reserved_.find(user);
+    uint64_t pending = it == reserved_.end() ? 0 : it->second;
+
+    projected = (limit > 0 ? committedBytes() : 0) + pending + bytes;
+    if (limit > 0 && projected > limit) return Reservation();
+
+    reserved_[user] = pending + bytes;
+    return Reservation(this, user, bytes);
+}
+
+uint64_t QuotaLedger::headroom(const Reservation& reservation, uint64_t limit,
+    const std::function<uint64_t()>& committedBytes)
+{
+    if (limit == 0) return UINT64_MAX;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = reserved_.find(reservation.user_);
+    uint64_t others = it == reserved_.end() || it->second < reservation.bytes_ ? 0 : it->second - reservation.bytes_;
+    uint64_t used = committedBytes() + others;
+    return used >= limit ? 0 : limit - used;
+}
+
+bool QuotaLedger::resize(Reservation& reservation, uint64_t bytes, uint64_t limit,
+    const std::function<uint64_t()>& committedBytes, uint64_t& projected)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = reserved_.find(reservation.user_);
+    uint64_t others = it == reserved_.end() || it->second < reservation.bytes_ ? 0 : it->second - reservation.bytes_;
+
+    projected = (limit > 0 ? committedBytes() : 0) + others + bytes;
+    if (limit > 0 && projected > limit) return false;
+
+    reserved_[reservation.user_] = others + bytes;
+    reservation.bytes_ = bytes;
+    return true;
+}
+
+void QuotaLedger::release(const std::string& user, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = reserved_.find(user);
+    if (it == reserved_.end()) return;
+    if (it->second <= bytes) reserved_.erase(it);
+    else it->second -= bytes;
+}
@@ -5,14 +5,117 @@
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <climits>
+#include <csignal>
+#include <ctime>
+#include <random>
 #include <QMetaObject>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include "SocketCompat.hpp"
 #include "CompressionHelper.hpp"
+#include "FileChecksum.hpp"
+#include "UploadFile.hpp"
+#include "StorageLayout.hpp"
+#include "PackStore.hpp"
+#include "HotFileCache.hpp"
+#include "CompressedVariants.hpp"
+#include "Sha256.hpp"
+#include "Logger.hpp"
 
 
+// Per-thread SO_REUSEPORT listeners need Linux, where the kernel balances
+// connections across them; other platforms share one listening socket.
+#if defined(__linux__) && defined(SO_REUSEPORT)
+#define FTP_LITE_REUSEPORT 1
+#include <pthread.h>
+#include <sched.h>
+#else
+#define FTP_LITE_REUSEPORT 0
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <mswsock.h>
+#endif
+
 namespace fs = std::filesystem;
 
+namespace {
+
+// Set by the SIGHUP handler, consumed by ServerApp::configWatchLoop.
+std::atomic<bool> sighupReceived{ false };
+
+// Distinguishes the temporary files of concurrent compressed downloads.
+std::atomic<uint64_t> downloadSequence{ 0 };
+
+#ifdef SIGHUP
+void onSighup(int)
+{
+    sighupReceived = true;
+}
+#endif
+
+// Reads one '\n'-terminated line of at most maxLength bytes.
+bool recvLine(SOCKET socket, std::string& line, size_t maxLength)
+{
+    line.clear();
+    char c;
+    while (line.size() < maxLength) {
+        if (recv(socket, &c, 1, 0) <= 0) return false;
+        if (c == '\n') {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return true;
+        }
+        line += c;
+    }
+    return false;
+}
+
+// Waits, with no timeout, until the socket takes more data; a drain's
+// shutdown() ends the wait and the send that follows fails.
+bool waitWritable(SOCKET socket)
+{
+    WSAPOLLFD entry{};
+    entry.fd = socket;
+    entry.events = POLLOUT;
+    for (;;) {
+        int ready = WSAPoll(&entry, 1, -1);
+        if (ready > 0) return true;
+        if (ready < 0 && WSAGetLastError() != WSAEINTR) return false;
+    }
+}
+
+void setBlocking(SOCKET socket, bool blocking)
+{
+    unsigned long nonBlocking = blocking ? 0 : 1;
+    ioctlsocket(socket, FIONBIO, &nonBlocking);
+}
+
+bool isSha256Hex(std::string_view text)
+{
+    if (text.size() != 64) return false;
+    for (char c : text)
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    return true;
+}
+
+// One "<name> <size> <uploadTime> <uploader>" line per file, as sent by LIST and SEARCH.
+std::string formatFileEntries(const std::vector<FileListEntry>& entries)
+{
+    std::string response;
+    for (const auto& entry : entries) {
+        response += entry.fileName + " " + std::to_string(entry.fileSize) + " " +
+            std::to_string(entry.uploadTime) + " " + entry.uploader + "\n";
+    }
+    return response;
+}
+
+}
+
 ServerApp::ServerApp(QObject* parent)
     : QObject(parent)
 {
@@ -23,20 +126,32 @@ ServerApp::~ServerApp()
     stop();
 }
 
+// Startup load: settings fixed for the life of the server, then the
+// reloadable ones through applyConfig().
 bool ServerApp::loadConfig()
 {
-    std::ifstream file(configPath_);
-    if (!file.is_open()) {
+    json cfg = json::object();
+    std::ifstream probe(configPath_);
+    if (!probe.is_open()) {
         emit logMessage("[Server] Config not found. Using defaults (port 2121, storage folder).");
-        return true;
+    }
+    else {
+        probe.close();
+        if (!readConfigFile(cfg)) return false;
     }
 
     try {
-        json cfg;
-        file >> cfg;
-        file.close();
         if (cfg.contains("serverPort")) serverPort_ = cfg["serverPort"];
         if (cfg.contains("storagePath")) storagePath_ = cfg["storagePath"];
+        if (cfg.contains("schedulerThreads")) schedulerThreads_ = cfg["schedulerThreads"];
+        if (cfg.contains("acceptThreads")) acceptThreads_ = cfg["acceptThreads"];
+        if (cfg.contains("pinAcceptThreads")) pinAcceptThreads_ = cfg["pinAcceptThreads"];
+        if (cfg.contains("snapshotIntervalMinutes")) snapshotOptions_.intervalMinutes = cfg["snapshotIntervalMinutes"];
+        if (cfg.contains("snapshotDir")) snapshotOptions_.snapshotDir = cfg["snapshotDir"];
+        if (cfg.contains("snapshotKeep")) snapshotOptions_.keepSnapshots = cfg["snapshotKeep"];
+        if (cfg.contains("snapshotPagesPerStep")) snapshotOptions_.pagesPerStep = cfg["snapshotPagesPerStep"];
+        if (cfg.contains("snapshotStepPauseMs")) snapshotOptions_.stepPauseMs = cfg["snapshotStepPauseMs"];
+        applyConfig(cfg);
         emit logMessage(QString("[Server] Config loaded. Port=%1, Storage=%2")
             .arg(serverPort_).arg(QString::fromStdString(storagePath_)));
         return true;
@@ -47,6 +162,166 @@ bool ServerApp::loadConfig()
     }
 }
 
+bool ServerApp::readConfigFile(json& cfg)
+{
+    std::ifstream file(configPath_);
+    if (!file.is_open()) return false;
+
+    // Remember the version read even if it fails to parse, so a broken file
+    // is reported once rather than on every poll.
+    std::error_code ec;
+    configWriteTime_ = fs::last_write_time(configPath_, ec);
+    try {
+        file >> cfg;
+        return true;
+    }
+    catch (std::exception& e) {
+        emit logMessage(QString("[Server] Config parse error: %1").arg(e.what()));
+        return false;
+    }
+}
+
+// Live reload: a bad file leaves the running config untouched.
+bool ServerApp::reloadConfig()
+{
+    json cfg;
+    if (!readConfigFile(cfg)) return false;
+
+    try {
+        if (cfg.value("serverPort", serverPort_) != serverPort_ ||
+            cfg.value("storagePath", storagePath_) != storagePath_ ||
+            cfg.value("acceptThreads", acceptThreads_) != acceptThreads_ ||
+            cfg.value("schedulerThreads", schedulerThreads_) != schedulerThreads_)
+            emit logMessage("[Server] Port, storage and thread layout changes take effect after a restart.");
+        applyConfig(cfg);
+        emit logMessage("[Server] Config reloaded.");
+        return true;
+    }
+    catch (std::exception& e) {
+        emit logMessage(QString("[Server] Config reload failed, keeping previous settings: %1").arg(e.what()));
+        return false;
+    }
+}
+
+// Builds a complete new snapshot (keys missing from the file get their
+// defaults), publishes it, then pushes it into the components that cache
+// settings of their own.
+void ServerApp::applyConfig(const json& cfg)
+{
+    auto next = std::make_shared<ServerConfig>();
+    if (cfg.contains("uploadChunkBytes")) next->uploadChunkBytes = cfg["uploadChunkBytes"];
+    if (cfg.contains("uploadPreallocate")) next->uploadPreallocate = cfg["uploadPreallocate"];
+    if (cfg.contains("fsyncPolicy")) {
+        std::string policy = cfg["fsyncPolicy"];
+        if (policy == "none") next->fsyncPolicy = FsyncPolicy::None;
+        else if (policy == "fdatasync") next->fsyncPolicy = FsyncPolicy::PerFile;
+        else if (policy == "batched") next->fsyncPolicy = FsyncPolicy::Batched;
+    }
+    if (cfg.contains("fsyncBatchMs")) next->fsyncBatchMs = cfg["fsyncBatchMs"];
+    if (cfg.contains("contentAddressedStorage")) next->contentAddressed = cfg["contentAddressedStorage"];
+    if (cfg.contains("packMaxFileBytes")) next->packMaxFileBytes = cfg["packMaxFileBytes"];
+    if (cfg.contains("packSegmentBytes")) next->packSegmentBytes = cfg["packSegmentBytes"];
+    if (cfg.contains("hotCacheBytes")) next->hotCacheBytes = cfg["hotCacheBytes"];
+    if (cfg.contains("hotCacheMaxFileBytes")) next->hotCacheMaxFileBytes = cfg["hotCacheMaxFileBytes"];
+    if (cfg.contains("hotCacheMinDownloads")) next->hotCacheMinDownloads = cfg["hotCacheMinDownloads"];
+    if (cfg.contains("compressedVariants")) next->compressedVariants = cfg["compressedVariants"];
+    if (cfg.contains("compressedVariantBytes")) next->compressedVariantBytes = cfg["compressedVariantBytes"];
+    if (cfg.contains("compressedVariantMinDownloads")) next->compressedVariantMinDownloads = cfg["compressedVariantMinDownloads"];
+    if (cfg.contains("maxConcurrentTransfers")) next->maxConcurrentTransfers = cfg["maxConcurrentTransfers"];
+    if (cfg.contains("transferQueueSize")) next->transferQueueSize = cfg["transferQueueSize"];
+    if (cfg.contains("transferQueueTimeoutMs")) next->transferQueueTimeoutMs = cfg["transferQueueTimeoutMs"];
+    if (cfg.contains("busyRetryAfterSeconds")) next->busyRetryAfterSeconds = cfg["busyRetryAfterSeconds"];
+    if (cfg.contains("drainTimeoutSeconds")) next->drainTimeoutSeconds = cfg["drainTimeoutSeconds"];
+    if (cfg.contains("downloadRetentionDays")) next->downloadRetentionDays = cfg["downloadRetentionDays"];
+    if (cfg.contains("retentionBatchSize")) next->retentionBatchSize = cfg["retentionBatchSize"];
+    if (cfg.contains("retentionIntervalMinutes")) next->retentionIntervalMinutes = cfg["retentionIntervalMinutes"];
+    if (cfg.contains("stagingMaxAgeHours")) next->stagingMaxAgeHours = cfg["stagingMaxAgeHours"];
+    if (cfg.contains("bandwidthGlobalBytesPerSec")) next->bandwidth.globalBytesPerSecond = cfg["bandwidthGlobalBytesPerSec"];
+    if (cfg.contains("bandwidthPerUserBytesPerSec")) next->bandwidth.perUserBytesPerSecond = cfg["bandwidthPerUserBytesPerSec"];
+    if (cfg.contains("bandwidthPerSessionBytesPerSec")) next->bandwidth.perSessionBytesPerSecond = cfg["bandwidthPerSessionBytesPerSec"];
+    if (cfg.contains("interactiveMaxBytes")) next->interactiveMaxBytes = cfg["interactiveMaxBytes"];
+    if (cfg.contains("ioSlots")) next->ioSlots = cfg["ioSlots"];
+    if (cfg.contains("sendSlots")) next->sendSlots = cfg["sendSlots"];
+    if (cfg.contains("interactiveWeight")) next->interactiveWeight = cfg["interactiveWeight"];
+    if (cfg.contains("bulkWeight")) next->bulkWeight = cfg["bulkWeight"];
+    if (cfg.contains("userQuotaBytes")) next->userQuotaBytes = cfg["userQuotaBytes"];
+    if (cfg.contains("userQuotas") && cfg["userQuotas"].is_object()) {
+        for (const auto& item : cfg["userQuotas"].items())
+            next->userQuotas[item.key()] = item.value().get<uint64_t>();
+    }
+    if (cfg.contains("logLevel")) {
+        std::string level = cfg["logLevel"];
+        next->logLevel = level == "debug" ? LogLevel::Debug : level == "error" ? LogLevel::Error : LogLevel::Info;
+    }
+    if (cfg.contains("logMaxBytes")) next->logRotation.maxBytes = cfg["logMaxBytes"];
+    if (cfg.contains("logMaxAgeMinutes")) next->logRotation.maxAgeMinutes = cfg["logMaxAgeMinutes"];
+    if (cfg.contains("logKeepFiles")) next->logRotation.keepFiles = cfg["logKeepFiles"];
+    if (cfg.contains("logCompressRotated")) next->logRotation.compress = cfg["logCompressRotated"];
+
+    next->uploadChunkBytes = std::clamp(next->uploadChunkBytes,
+        ServerConfig::MIN_UPLOAD_CHUNK_BYTES, ServerConfig::MAX_UPLOAD_CHUNK_BYTES);
+    next->maxConcurrentTransfers = std::max(1, next->maxConcurrentTransfers);
+    next->transferQueueSize = std::max(0, next->transferQueueSize);
+    next->retentionIntervalMinutes = std::max(1, next->retentionIntervalMinutes);
+
+    std::atomic_store(&config_, std::shared_ptr<const ServerConfig>(next));
+
+    Logger::setLevel(next->logLevel);
+    Logger::setRotation(next->logRotation);
+    shaper_.configure(next->bandwidth);
+    committer_.configure(next->fsyncPolicy, next->fsyncBatchMs);
+    packStore_.configure(next->packSegmentBytes);
+    hotCache_.configure(next->hotCacheBytes, next->hotCacheMaxFileBytes, next->hotCacheMinDownloads);
+    variants_.configure(next->compressedVariants ? next->compressedVariantBytes : 0,
+        next->compressedVariantMinDownloads);
+    transferScheduler_.configure(static_cast<size_t>(std::max(1, next->ioSlots)),
+        static_cast<unsigned>(std::max(1, next->interactiveWeight)),
+        static_cast<unsigned>(std::max(1, next->bulkWeight)));
+    sendScheduler_.configure(static_cast<size_t>(std::max(1, next->sendSlots)),
+        static_cast<unsigned>(std::max(1, next->interactiveWeight)),
+        static_cast<unsigned>(std::max(1, next->bulkWeight)));
+    if (workerPool_)
+        workerPool_->resize(static_cast<size_t>(next->maxConcurrentTransfers),
+            static_cast<size_t>(next->transferQueueSize));
+    {
+        std::lock_guard<std::mutex> lock(maintenanceMutex_);
+        ++configGeneration_;
+    }
+    maintenanceCv_.notify_all();
+}
+
+std::shared_ptr<const ServerConfig> ServerApp::currentConfig() const
+{
+    return std::atomic_load(&config_);
+}
+
+void ServerApp::requestConfigReload()
+{
+    reloadRequested_ = true;
+    maintenanceCv_.notify_all();
+}
+
+// Polls the config file's modification time (and the SIGHUP flag) every
+// CONFIG_POLL_SECONDS and reloads when either fires.
+void ServerApp::configWatchLoop()
+{
+    std::unique_lock<std::mutex> lock(maintenanceMutex_);
+    while (running_) {
+        maintenanceCv_.wait_for(lock, std::chrono::seconds(CONFIG_POLL_SECONDS),
+            [this] { return !running_ || reloadRequested_ || sighupReceived; });
+        if (!running_) break;
+        lock.unlock();
+
+        std::error_code ec;
+        auto writeTime = fs::last_write_time(configPath_, ec);
+        bool changed = !ec && writeTime != configWriteTime_;
+        if (reloadRequested_.exchange(false) | sighupReceived.exchange(false) | changed)
+            reloadConfig();
+
+        lock.lock();
+    }
+}
+
 bool ServerApp::start()
 {
     if (!loadConfig()) return false;
@@ -57,12 +332,92 @@ bool ServerApp::start()
         return false;
     }
 
-    serverSocket_ = socket(AF_INET, SOCK_STREAM, 0);
+    int acceptThreads = std::max(1, acceptThreads_);
+    bool reusePort = FTP_LITE_REUSEPORT && acceptThreads > 1;
+
+    serverSocket_ = openListener(reusePort);
     if (serverSocket_ == INVALID_SOCKET) {
-        emit logMessage("[Server] Failed to create socket.");
         WSACleanup();
         return false;
     }
+    if (reusePort) {
+        std::lock_guard<std::mutex> lock(listenersMutex_);
+        for (int i = 1; i < acceptThreads; ++i) {
+            SOCKET listener = openListener(true);
+            if (listener == INVALID_SOCKET) break;
+            extraListeners_.push_back(listener);
+        }
+        acceptThreads = 1 + static_cast<int>(extraListeners_.size());
+    }
+
+    emit logMessage(QString("[Server] Listening on port %1 (%2 accept thread(s)%3)...")
+        .arg(serverPort_).arg(acceptThreads).arg(reusePort ? ", SO_REUSEPORT" : ""));
+    running_ = true;
+    forceClosing_ = false;
+
+    retentionThread_ = std::thread(&ServerApp::retentionLoop, this);
+    configWatchThread_ = std::thread(&ServerApp::configWatchLoop, this);
+#ifdef SIGHUP
+    std::signal(SIGHUP, onSighup);
+#endif
+#ifdef SIGPIPE
+    std::signal(SIGPIPE, SIG_IGN);      // a vanished client must fail send(), not kill the server
+#endif
+
+    snapshotter_ = std::make_unique<MetadataSnapshotter>(snapshotOptions_);
+    snapshotter_->start();
+
+    if (!packStore_.open(storagePath_))
+        emit logMessage("[Server] Pack segments unavailable, small files are stored individually.");
+    variants_.open(storagePath_);
+
+    scheduler_ = std::make_unique<TaskScheduler>(static_cast<size_t>(std::max(0, schedulerThreads_)));
+    workerPool_ = std::make_unique<WorkerPool>(
+        static_cast<size_t>(currentConfig()->maxConcurrentTransfers),
+        static_cast<size_t>(currentConfig()->transferQueueSize));
+
+    // stop() may clear extraListeners_ at any time; work from a copy.
+    std::vector<SOCKET> listeners;
+    {
+        std::lock_guard<std::mutex> lock(listenersMutex_);
+        listeners = extraListeners_;
+    }
+    std::vector<std::thread> acceptors;
+    for (int i = 1; i < acceptThreads; ++i)
+        acceptors.emplace_back(&ServerApp::acceptLoop, this,
+            reusePort && i - 1 < static_cast<int>(listeners.size()) ? listeners[i - 1] : serverSocket_, i);
+    acceptLoop(serverSocket_, 0);
+    for (auto& acceptor : acceptors) acceptor.join();
+
+    // Drain: queued connections are answered BUSY rather than started, then
+    // in-flight transfers finish, then CPU stages and background jobs, and
+    // finally the WAL and the log.
+    workerPool_->closeQueue();
+    drainConnections();
+    workerPool_->shutdown();
+    scheduler_->shutdown();
+    maintenanceCv_.notify_all();
+    if (retentionThread_.joinable()) retentionThread_.join();
+    if (configWatchThread_.joinable()) configWatchThread_.join();
+    committer_.shutdown();
+    packStore_.close();
+    if (snapshotter_) snapshotter_->stop();
+    MetadataManager("server_metadata.db").checkpoint();
+
+    closesocket(serverSocket_);
+    WSACleanup();
+    emit logMessage("[Server] Server stopped.");
+    Logger::flush();
+    return true;
+}
+
+SOCKET ServerApp::openListener(bool reusePort)
+{
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET) {
+        emit logMessage("[Server] Failed to create socket.");
+        return INVALID_SOCKET;
+    }
 
     sockaddr_in serverAddr{};
     serverAddr.sin_family = AF_INET;
@@ -70,29 +425,50 @@ bool ServerApp::start()
     serverAddr.sin_port = htons(serverPort_);
 
     BOOL opt = TRUE;
-    setsockopt(serverSocket_, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char*)&opt, sizeof(opt));
+#if FTP_LITE_REUSEPORT
+    if (reusePort)
+        setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, (const char*)&opt, sizeof(opt));
+#endif
+#ifdef SO_EXCLUSIVEADDRUSE
+    setsockopt(listener, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char*)&opt, sizeof(opt));
+#else
+    // Rebinding over TIME_WAIT after a restart; a live listener still blocks the bind.
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt));
+#endif
+    (void)reusePort;
 
-    if (bind(serverSocket_, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
+    if (bind(listener, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
         emit logMessage("[Server] Bind failed! Port may be in use.");
-        closesocket(serverSocket_);
-        WSACleanup();
-        return false;
+        closesocket(listener);
+        return INVALID_SOCKET;
     }
 
-    if (listen(serverSocket_, SOMAXCONN) == SOCKET_ERROR) {
+    if (listen(listener, SOMAXCONN) == SOCKET_ERROR) {
         emit logMessage("[Server] Listen failed!");
-        closesocket(serverSocket_);
-        WSACleanup();
-        return false;
+        closesocket(listener);
+        return INVALID_SOCKET;
     }
+    return listener;
+}
 
-    emit logMessage(QString("[Server] Listening on port %1...").arg(serverPort_));
-    running_ = true;
+void ServerApp::acceptLoop(SOCKET listener, int index)
+{
+#if FTP_LITE_REUSEPORT
+    unsigned cores = std::thread::hardware_concurrency();
+    if (pinAcceptThreads_ && cores > 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(static_cast<unsigned>(index) % cores, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#else
+    (void)index;
+#endif
 
     while (running_) {
         sockaddr_in clientAddr{};
-        int clientLen = sizeof(clientAddr);
-        SOCKET clientSocket = accept(serverSocket_, (sockaddr*)&clientAddr, &clientLen);
+        socklen_t clientLen = sizeof(clientAddr);
+        SOCKET clientSocket = accept(listener, (sockaddr*)&clientAddr, &clientLen);
         if (clientSocket == INVALID_SOCKET) continue;
 
     //    char clientIp[INET_ADDRSTRLEN];
@@ -104,22 +480,579 @@ bool ServerApp::start()
 
         emit clientConnected(QString::fromUtf8(ipStr));
 
-        std::thread(&ServerApp::handleClient, this, clientSocket).detach();
+        bool admitted = workerPool_->submit(
+            [this, clientSocket] {
+                if (!beginConnection(clientSocket)) {
+                    rejectBusy(clientSocket);
+                    return;
+                }
+                try {
+                    handleClient(clientSocket);
+                }
+                catch (const std::exception& e) {
+                    emit logMessage(QString("[Server] Client handler failed: %1").arg(e.what()));
+                }
+                endConnection(clientSocket);
+                closesocket(clientSocket);
+            },
+            [this, clientSocket] { rejectBusy(clientSocket); },
+            std::chrono::milliseconds(currentConfig()->transferQueueTimeoutMs));
+        if (!admitted) rejectBusy(clientSocket);
     }
-
-    closesocket(serverSocket_);
-    WSACleanup();
-    emit logMessage("[Server] Server stopped.");
-    return true;
 }
 
 void ServerApp::stop()
 {
-    running_ = false;
+    {
+        std::lock_guard<std::mutex> lock(maintenanceMutex_);
+        running_ = false;
+    }
+    maintenanceCv_.notify_all();
+
+    // shutdown() first: on Linux closing a socket does not wake a blocked accept().
     if (serverSocket_ != INVALID_SOCKET) {
+        shutdown(serverSocket_, SD_BOTH);
         closesocket(serverSocket_);
         serverSocket_ = INVALID_SOCKET;
     }
+    std::lock_guard<std::mutex> lock(listenersMutex_);
+    for (SOCKET listener : extraListeners_) {
+        shutdown(listener, SD_BOTH);
+        closesocket(listener);
+    }
+    extraListeners_.clear();
+}
+
+bool ServerApp::beginConnection(SOCKET clientSocket)
+{
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    if (forceClosing_) return false;
+    activeConnections_.insert(clientSocket);
+    return true;
+}
+
+// Called before the socket is closed, so a drain never shuts down a reused handle.
+void ServerApp::endConnection(SOCKET clientSocket)
+{
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    auto it = activeConnections_.find(clientSocket);
+    if (it != activeConnections_.end()) activeConnections_.erase(it);
+    if (activeConnections_.empty()) connectionsCv_.notify_all();
+}
+
+// Waits up to drainTimeoutSeconds for in-flight transfers, then shuts the
+// remaining sockets down so their handlers return. Queued connections that
+// have not started by then are answered BUSY.
+void ServerApp::drainConnections()
+{
+    std::unique_lock<std::mutex> lock(connectionsMutex_);
+    if (!activeConnections_.empty())
+        emit logMessage(QString("[Server] Draining %1 connection(s)...").arg(activeConnections_.size()));
+
+    auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::seconds(std::max(0, currentConfig()->drainTimeoutSeconds));
+    bool drained = connectionsCv_.wait_until(lock, deadline, [this] { return activeConnections_.empty(); });
+    forceClosing_ = true;
+
+    if (!drained) {
+        emit logMessage(QString("[Server] Drain timeout, closing %1 connection(s).").arg(activeConnections_.size()));
+        for (SOCKET clientSocket : activeConnections_)
+            shutdown(clientSocket, SD_BOTH);
+    }
+}
+
+// Turns a connection away without reading its command; the client retries later.
+void ServerApp::rejectBusy(SOCKET clientSocket)
+{
+    std::string response = "BUSY " + std::to_string(currentConfig()->busyRetryAfterSeconds) + "\n";
+    send(clientSocket, response.c_str(), static_cast<int>(response.size()), 0);
+    // FIN behind the reply, so the client can read it while still sending.
+    shutdown(clientSocket, SD_SEND);
+    closesocket(clientSocket);
+    emit logMessage("[Server] Busy, connection rejected.");
+}
+
+// Rolls download rows older than the retention window into per-day aggregates.
+// Works in small batches with a pause between them so uploads and downloads
+// never wait long on the write lock.
+void ServerApp::retentionLoop()
+{
+    MetadataManager metadataDB("server_metadata.db");
+
+    std::unique_lock<std::mutex> lock(maintenanceMutex_);
+    while (running_) {
+        lock.unlock();
+
+        auto config = currentConfig();
+        long long total = 0;
+        if (config->downloadRetentionDays > 0) {
+            long long cutoff = static_cast<long long>(std::time(nullptr)) -
+                static_cast<long long>(config->downloadRetentionDays) * 86400;
+            int compacted;
+            while (running_ && (compacted = metadataDB.compactDownloadHistory(cutoff, config->retentionBatchSize)) > 0) {
+                total += compacted;
+                std::this_thread::sleep_for(std::chrono::milliseconds(RETENTION_BATCH_PAUSE_MS));
+            }
+        }
+        if (total > 0)
+            emit logMessage(QString("[Server] Compacted %1 download records older than %2 days.")
+                .arg(total).arg(config->downloadRetentionDays));
+
+        if (config->stagingMaxAgeHours > 0) {
+            int swept = committer_.sweep(storagePath_, std::chrono::hours(config->stagingMaxAgeHours));
+            if (swept > 0)
+                emit logMessage(QString("[Server] Removed %1 unfinished upload(s) older than %2 hours.")
+                    .arg(swept).arg(config->stagingMaxAgeHours));
+        }
+
+        // A reload wakes the wait early so a new interval or window applies now.
+        lock.lock();
+        uint64_t generation = configGeneration_;
+        maintenanceCv_.wait_for(lock, std::chrono::minutes(config->retentionIntervalMinutes),
+            [this, generation] { return !running_ || configGeneration_ != generation; });
+    }
+}
+
+// Quota admission: committed usage (less the file this upload replaces)
+// plus uploads still in flight must leave room for it. Replies QUOTA and
+// returns an empty reservation if not.
+QuotaLedger::Reservation ServerApp::admitUpload(SOCKET clientSocket, MetadataManager& metadataDB,
+    const ServerConfig& config, const std::string& fileName, const std::string& uploader, uint64_t size)
+{
+    uint64_t quota = config.quotaFor(uploader);
+    uint64_t projected = 0;
+    auto reservation = quotaLedger_.reserve(uploader, size, quota,
+        [&] { return committedUsage(metadataDB, fileName, uploader); }, projected);
+    if (!reservation) {
+        std::string response = "QUOTA " + std::to_string(quota) + "\n";
+        send(clientSocket, response.c_str(), static_cast<int>(response.size()), 0);
+        emit logMessage(QString("[Server] Upload of %1 by %2 refused: %3 bytes would exceed quota of %4.")
+            .arg(QString::fromStdString(fileName)).arg(QString::fromStdString(uploader))
+            .arg(projected).arg(quota));
+    }
+    return reservation;
+}
+
+// The uploader's usage other than fileName: committed files less the one
+// this upload replaces, plus unfinished uploads, which hold disk space too.
+// This file's own staged bytes are part of its reservation.
+uint64_t ServerApp::committedUsage(MetadataManager& metadataDB, const std::string& fileName, const std::string& uploader)
+{
+    long long used = metadataDB.getUserUsage(uploader).bytesUsed;
+    FileMetadata existing = metadataDB.getFileMetadataRecord(fileName);
+    if (!existing.fileName.empty() && existing.uploader == uploader) used -= existing.fileSize;
+    return static_cast<uint64_t>(std::max(0LL, used)) + committer_.stagedBytes(storagePath_, uploader, fileName);
+}
+
+// Removes what a replaced file left behind: its blob once nothing references
+// it any more, or its own file (flat or sharded) if it was not a blob.
+// Callers hold blobMutex_ when either side is content-addressed.
+void ServerApp::releaseReplaced(MetadataManager& metadataDB, const FileMetadata& previous, const std::string& newPath)
+{
+    // A pack segment is shared; the old entry just becomes dead space.
+    if (previous.fileName.empty() || previous.storagePath == newPath || previous.packOffset >= 0) return;
+
+    std::error_code ec;
+    if (!previous.contentHash.empty()) {
+        if (metadataDB.dropBlobIfUnreferenced(previous.contentHash))
+            fs::remove(StorageLayout::resolve(storagePath_, previous), ec);
+    }
+    else {
+        fs::remove(StorageLayout::resolve(storagePath_, previous), ec);
+    }
+}
+
+// UPLOADREF <fileName> <sha256> <size> <uploader>
+// Stores fileName as a reference to an existing blob without transferring
+// it. Knowing the hash is not enough: the client must hash a random range
+// of the content, prefixed with a fresh nonce, to show it has the data.
+//   server: CHALLENGE <nonce> <offset> <length> | NEED
+//   client: PROOF <sha256(nonce + bytes[offset, offset + length))>
+//   server: OK | NEED   (NEED: fall back to a normal UPLOAD)
+void ServerApp::handleUploadRef(SOCKET clientSocket, MetadataManager& metadataDB, const ServerConfig& config,
+    const CommandParser& parser)
+{
+    auto reply = [&](const std::string& text) {
+        send(clientSocket, text.c_str(), static_cast<int>(text.size()), 0);
+    };
+
+    std::string fileName(parser.getArg(0));
+    std::string contentHash(parser.getArg(1));
+    std::string uploader(parser.getArg(3));
+    uint64_t size = 0;
+    if (fileName.empty() || !isSha256Hex(contentHash) || !parser.getNumber(2, size)) {
+        emit logMessage("[Server] Malformed UPLOADREF command.");
+        return;
+    }
+
+    std::string relativePath = StorageLayout::blobPath(contentHash);
+    std::string blobFile = storagePath_ + "/" + relativePath;
+    std::error_code ec;
+    BlobInfo blob = metadataDB.getBlob(contentHash);
+    if (!config.contentAddressed || blob.refcount <= 0 ||
+        static_cast<uint64_t>(blob.size) != size || !fs::exists(blobFile, ec)) {
+        reply("NEED\n");
+        return;
+    }
+
+    auto quotaHold = admitUpload(clientSocket, metadataDB, config, fileName, uploader, size);
+    if (!quotaHold) return;
+
+    std::random_device random;
+    Sha256::Digest nonceBytes;
+    for (auto& byte : nonceBytes) byte = static_cast<uint8_t>(random());
+    std::string nonce = Sha256::toHex(nonceBytes).substr(0, 32);
+    uint64_t length = std::min<uint64_t>(size, POSSESSION_PROOF_BYTES);
+    uint64_t offset = size > length ? std::uniform_int_distribution<uint64_t>(0, size - length)(random) : 0;
+
+    reply("CHALLENGE " + nonce + " " + std::to_string(offset) + " " + std::to_string(length) + "\n");
+
+    std::string line;
+    std::string expected;
+    if (!recvLine(clientSocket, line, 128) || line.rfind("PROOF ", 0) != 0 ||
+        !Sha256::hashFile(blobFile, nonce, offset, length, expected) || line.substr(6) != expected) {
+        reply("NEED\n");
+        emit logMessage(QString("[Server] UPLOADREF of %1 by %2 failed the possession check.")
+            .arg(QString::fromStdString(fileName)).arg(QString::fromStdString(uploader)));
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> blobLock(blobMutex_);
+        // The blob may have lost its last reference while the client answered.
+        if (metadataDB.getBlob(contentHash).refcount <= 0 || !fs::exists(blobFile, ec)) {
+            reply("NEED\n");
+            return;
+        }
+        FileMetadata previous = metadataDB.getFileMetadataRecord(fileName);
+        metadataDB.updateFileMetadata(fileName, uploader, static_cast<long>(size), blob.checksum,
+            relativePath, contentHash);
+        releaseReplaced(metadataDB, previous, relativePath);
+    }
+    invalidateDerived(fileName);
+
+    reply("OK\n");
+    emit logMessage(QString("[Server] %1 by %2 stored as a reference to an existing blob.")
+        .arg(QString::fromStdString(fileName)).arg(QString::fromStdString(uploader)));
+    emit fileUploaded(QString::fromStdString(fileName));
+}
+
+// Small uploads are received into memory and appended to a pack segment:
+// no staging file, rename or directory entry of their own. An interrupted
+// one is staged like any other upload so the client can resume it.
+void ServerApp::receivePacked(SOCKET clientSocket, MetadataManager& metadataDB, const std::string& fileName,
+    const std::string& uploader, size_t fileSize, std::string_view payload)
+{
+    auto shaping = shaper_.openSession(uploader);
+    std::string data(payload.substr(0, fileSize));
+    shaping->throttle(data.size());
+    while (data.size() < fileSize) {
+        size_t have = data.size();
+        data.resize(fileSize);
+        int received = recv(clientSocket, data.data() + have, static_cast<int>(fileSize - have), 0);
+        data.resize(have + static_cast<size_t>(std::max(received, 0)));
+        if (received <= 0) break;
+        shaping->throttle(static_cast<uint64_t>(received));
+    }
+
+    if (data.size() < fileSize) {
+        auto staging = committer_.stage(storagePath_, fileName, uploader);
+        UploadFile partial;
+        if (staging && partial.open(staging.path(), 0)) {
+            partial.writeAt(data.data(), data.size(), 0);
+            partial.finish(data.size());
+        }
+        emit logMessage(QString("[Server] Upload of %1 interrupted at %2/%3 bytes, kept for resume.")
+            .arg(QString::fromStdString(fileName)).arg(data.size()).arg(fileSize));
+        return;
+    }
+
+    PackStore::Location location;
+    {
+        auto slot = transferScheduler_.acquire(TransferClass::Interactive, data.size());
+        if (!packStore_.append(data.data(), data.size(), location) ||
+            !committer_.syncAppended(storagePath_ + "/" + location.relativePath)) {
+            emit logMessage(QString("[Server] Could not store %1 in a pack segment.")
+                .arg(QString::fromStdString(fileName)));
+            return;
+        }
+    }
+    std::string checksum = FileChecksum::toHex(FileChecksum::crc32Buffer(data.data(), data.size()));
+
+    {
+        // The file may be replacing a blob reference.
+        std::lock_guard<std::mutex> blobLock(blobMutex_);
+        FileMetadata previous = metadataDB.getFileMetadataRecord(fileName);
+        metadataDB.updateFileMetadata(fileName, uploader, static_cast<long>(fileSize), checksum,
+            location.relativePath, "", static_cast<long long>(location.offset));
+        releaseReplaced(metadataDB, previous, location.relativePath);
+    }
+    invalidateDerived(fileName);
+
+    send(clientSocket, "OK\n", 3, 0);
+    emit logMessage(QString("[Server] Upload complete: %1 by %2 (packed)")
+        .arg(QString::fromStdString(fileName))
+        .arg(QString::fromStdString(uploader)));
+    emit fileUploaded(QString::fromStdString(fileName));
+}
+
+// DOWNLOAD <fileName> <offset> <user> <compress>
+// Replies DATA <length> and the file's bytes from offset on, then closes
+// the connection.
+// A packed file is the same kind of range, inside its segment.
+void ServerApp::handleDownload(SOCKET clientSocket, MetadataManager& metadataDB, const ServerConfig& config,
+    const CommandParser& parser)
+{
+    std::string fileName(parser.getArg(0));
+    std::string downloader(parser.getArg(2));
+    bool compress = (parser.getArg(3) == "1");
+    uint64_t offset = 0;
+    if (fileName.empty() || !parser.getNumber(1, offset)) {
+        emit logMessage("[Server] Malformed DOWNLOAD command.");
+        return;
+    }
+
+    FileMetadata meta = metadataDB.getFileMetadataRecord(fileName);
+    if (meta.fileName.empty()) {
+        emit logMessage(QString("[Server] Download of unknown file %1.").arg(QString::fromStdString(fileName)));
+        return;
+    }
+
+    // A file of its own is sent at its size on disk: files.size of older
+    // compressed uploads is their compressed length. A packed entry has no
+    // other record of its length.
+    std::error_code ec;
+    std::string path = StorageLayout::resolve(storagePath_, meta);
+    uint64_t start = meta.packOffset >= 0 ? static_cast<uint64_t>(meta.packOffset) : 0;
+    uint64_t size = meta.packOffset >= 0 ? static_cast<uint64_t>(meta.fileSize) : fs::file_size(path, ec);
+    if (ec) {
+        emit logMessage(QString("[Server] Stored data of %1 is missing: %2")
+            .arg(QString::fromStdString(fileName)).arg(QString::fromStdString(ec.message())));
+        return;
+    }
+    HotVariant variant = compress ? HotVariant::Gzip : HotVariant::Raw;
+    bool useVariants = compress && meta.packOffset < 0 && config.compressedVariants;
+    CompressedVariants::Handle stored = useVariants ? variants_.find(meta) : CompressedVariants::Handle();
+
+    // Popular small files are sent from memory. Packed files are small too,
+    // so a compressed one is gzipped in memory rather than through a
+    // temporary file. The client's offset counts compressed bytes.
+    HotFileCache::Data data;
+    bool hot = hotCache_.admits(meta);
+    std::string version = HotFileCache::versionOf(meta);
+    if (hot) data = hotCache_.get(fileName, variant, version);
+    if (!data && (hot || (compress && meta.packOffset >= 0))) {
+        data = stored ? loadVariant(stored.path(), 0, stored.size(), HotVariant::Raw)
+            : loadVariant(path, start, size, variant);
+        if (data && hot) hotCache_.put(fileName, variant, version, data);
+    }
+
+    // Otherwise a compressed download is a stored variant, or gzipped into a
+    // temporary file that then becomes the variant for the next request.
+    std::string temporary;
+    if (!data && compress && stored) {
+        path = stored.path();
+        start = 0;
+        size = stored.size();
+    }
+    else if (!data && compress) {
+        temporary = storagePath_ + "/" + UploadCommitter::STAGING_DIR + "/" + fileName + "." +
+            std::to_string(++downloadSequence) + ".gz";
+        fs::create_directories(fs::path(temporary).parent_path(), ec);
+        if (!CompressionHelper::compressFile(path, temporary)) {
+            fs::remove(temporary, ec);
+            emit logMessage(QString("[Server] Could not compress %1 for download.").arg(QString::fromStdString(fileName)));
+            return;
+        }
+        path = temporary;
+        start = 0;
+        size = fs::file_size(path, ec);
+    }
+    if (data) size = data->size();
+
+    bool sent = offset <= size;
+    if (sent) {
+        std::string header = "DATA " + std::to_string(size - offset) + "\n";
+        send(clientSocket, header.c_str(), static_cast<int>(header.size()), 0);
+        TransferClass transferClass = size - offset <= config.interactiveMaxBytes
+            ? TransferClass::Interactive : TransferClass::Bulk;
+        auto shaping = shaper_.openSession(downloader);
+        sent = data ? sendBuffer(clientSocket, *data, offset, config.uploadChunkBytes, transferClass, *shaping)
+                    : sendRange(clientSocket, path, start + offset, size - offset, config.uploadChunkBytes,
+                          transferClass, *shaping);
+    }
+    if (!temporary.empty() && !(useVariants && variants_.admits(meta) && variants_.publish(temporary, meta)))
+        fs::remove(temporary, ec);
+
+    if (!sent) {
+        emit logMessage(QString("[Server] Download of %1 by %2 stopped early.")
+            .arg(QString::fromStdString(fileName)).arg(QString::fromStdString(downloader)));
+        return;
+    }
+    metadataDB.updateDownloadRecord(fileName, downloader);
+    emit logMessage(QString("[Server] Download complete: %1 by %2")
+        .arg(QString::fromStdString(fileName)).arg(QString::fromStdString(downloader)));
+}
+
+// Drops what was derived from the previous content of a re-uploaded file.
+void ServerApp::invalidateDerived(const std::string& fileName)
+{
+    hotCache_.invalidate(fileName);
+    variants_.invalidate(fileName);
+}
+
+// Reads a stored file (or its range of a pack segment) into memory, gzipped
+// for the Gzip variant. Null if it cannot be read.
+HotFileCache::Data ServerApp::loadVariant(const std::string& path, uint64_t start, uint64_t size, HotVariant variant)
+{
+    auto raw = std::make_shared<std::string>(static_cast<size_t>(size), '\0');
+    std::ifstream in(path, std::ios::binary);
+    in.seekg(static_cast<std::streamoff>(start));
+    if (!in.read(raw->data(), static_cast<std::streamsize>(size))) return nullptr;
+    if (variant == HotVariant::Raw) return raw;
+
+    auto gzipped = std::make_shared<std::string>();
+    if (!CompressionHelper::compressBuffer(raw->data(), raw->size(), *gzipped)) return nullptr;
+    return gzipped;
+}
+
+// Sends data from offset on in chunks, paced by the downloader's bandwidth
+// limits.
+bool ServerApp::sendBuffer(SOCKET clientSocket, const std::string& data, uint64_t offset, size_t chunkBytes,
+    TransferClass transferClass, BandwidthShaper::Session& shaping)
+{
+    size_t position = static_cast<size_t>(offset);
+    while (position < data.size()) {
+        size_t take = std::min<size_t>(data.size() - position, chunkBytes);
+        if (!sendSlotted(clientSocket, data.data() + position, take, transferClass)) return false;
+        position += take;
+        shaping.throttle(take);
+    }
+    return true;
+}
+
+// Sends all of data, holding a send slot only while the socket takes it.
+// A client slow to read fills its socket buffer; the send then waits for
+// room with no slot held, so slow downloaders cannot take every slot from
+// LIST and SEARCH replies.
+bool ServerApp::sendSlotted(SOCKET clientSocket, const char* data, size_t length, TransferClass transferClass)
+{
+    setBlocking(clientSocket, false);
+    bool ok = true;
+    while (ok && length > 0) {
+        if (!waitWritable(clientSocket)) {
+            ok = false;
+            break;
+        }
+        auto slot = sendScheduler_.acquire(transferClass, length);
+        while (length > 0) {
+            int sent = send(clientSocket, data, static_cast<int>(std::min<size_t>(length, INT_MAX)), 0);
+            if (sent > 0) {
+                data += sent;
+                length -= static_cast<size_t>(sent);
+                continue;
+            }
+            int error = WSAGetLastError();
+            if (sent < 0 && error == WSAEINTR) continue;
+            if (sent < 0 && error != WSAEWOULDBLOCK) ok = false;
+            break;
+        }
+    }
+    setBlocking(clientSocket, true);
+    return ok;
+}
+
+// Sends [offset, offset + length) of a file in chunks, paced by the
+// downloader's bandwidth limits. sendfile() on Linux and TransmitFile() on
+// Windows move the data from the page cache to the socket without a copy
+// through user space. As in sendSlotted(), a send slot is held only while
+// the socket takes data.
+bool ServerApp::sendRange(SOCKET clientSocket, const std::string& path, uint64_t offset, uint64_t length,
+    size_t chunkBytes, TransferClass transferClass, BandwidthShaper::Session& shaping)
+{
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    // Non-blocking, sendfile() stops at a full socket buffer instead of
+    // waiting for the client with the slot held.
+    setBlocking(clientSocket, false);
+    off_t position = static_cast<off_t>(offset);
+    bool ok = true;
+    while (ok && length > 0) {
+        size_t take = static_cast<size_t>(std::min<uint64_t>(length, chunkBytes));
+        size_t moved = 0;
+        if (!waitWritable(clientSocket)) {
+            ok = false;
+            break;
+        }
+        {
+            auto slot = sendScheduler_.acquire(transferClass, take);
+            while (moved < take) {
+                ssize_t sent = ::sendfile(clientSocket, fd, &position, take - moved);
+                if (sent > 0) {
+                    moved += static_cast<size_t>(sent);
+                    continue;
+                }
+                if (sent < 0 && errno == EINTR) continue;
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                ok = false;
+                break;
+            }
+        }
+        length -= moved;
+        shaping.throttle(moved);
+    }
+    setBlocking(clientSocket, true);
+    ::close(fd);
+    return ok;
+#elif defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    // TransmitFile() has no non-blocking form, so each call is kept to what
+    // the socket buffer holds once the socket is writable.
+    int bufferBytes = 0;
+    int optionLength = sizeof(bufferBytes);
+    getsockopt(clientSocket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<char*>(&bufferBytes), &optionLength);
+    uint64_t most = bufferBytes > 0 ? static_cast<uint64_t>(bufferBytes) : 64 * 1024;
+    bool ok = true;
+    while (ok && length > 0) {
+        DWORD take = static_cast<DWORD>(std::min<uint64_t>({ length, static_cast<uint64_t>(chunkBytes), most }));
+        if (!waitWritable(clientSocket)) {
+            ok = false;
+            break;
+        }
+        {
+            auto slot = sendScheduler_.acquire(transferClass, take);
+            LARGE_INTEGER position;
+            position.QuadPart = static_cast<LONGLONG>(offset);
+            ok = SetFilePointerEx(file, position, nullptr, FILE_BEGIN) &&
+                TransmitFile(clientSocket, file, take, 0, nullptr, nullptr, 0);
+        }
+        if (!ok) break;
+        offset += take;
+        length -= take;
+        shaping.throttle(take);
+    }
+    CloseHandle(file);
+    return ok;
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+    in.seekg(static_cast<std::streamoff>(offset));
+    std::vector<char> chunk;
+    while (length > 0) {
+        chunk.resize(static_cast<size_t>(std::min<uint64_t>(length, chunkBytes)));
+        {
+            auto slot = transferScheduler_.acquire(transferClass, chunk.size());
+            if (!in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()))) return false;
+        }
+        if (!sendSlotted(clientSocket, chunk.data(), chunk.size(), transferClass)) return false;
+        length -= chunk.size();
+        shaping.throttle(chunk.size());
+    }
+    return true;
+#endif
 }
 
 void ServerApp::handleClient(SOCKET clientSocket)
@@ -131,53 +1064,267 @@ void ServerApp::handleClient(SOCKET clientSocket)
     int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
     if (bytesReceived <= 0) {
         emit logMessage("[Server] Client disconnected.");
-        closesocket(clientSocket);
         return;
     }
 
-    buffer[bytesReceived] = '\0';
-    std::string commandStr(buffer);
-    CommandParser parser(commandStr);
-    std::string command = parser.getCommand();
+    // Clients send UPLOAD data right behind the command line, so the first
+    // read may already hold some of it.
+    std::string_view received(buffer, bytesReceived);
+    size_t lineEnd = received.find('\n');
+    std::string_view payload = lineEnd == std::string_view::npos ? std::string_view() : received.substr(lineEnd + 1);
+
+    CommandParser parser(received.substr(0, lineEnd));
+    CommandType command = parser.type();
+    // One snapshot for the whole session: a reload meanwhile applies to
+    // the next connection, never to half of this one.
+    auto config = currentConfig();
+
+    if (command == CommandType::Upload) {
+        std::string fileName(parser.getArg(0));
+        std::string uploader(parser.getArg(3));
+        bool compressed = (parser.getArg(4) == "1");
 
-    if (command == "UPLOAD") {
-        std::string fileName = parser.getArg(0);
-        std::string fileSizeStr = parser.getArg(1);
-        std::string offsetStr = parser.getArg(2);
-        std::string uploader = parser.getArg(3);
-        std::string compressedStr = parser.getArg(4);
+        size_t fileSize = 0;
+        size_t offset = 0;
+        if (fileName.empty() || !parser.getNumber(1, fileSize) || !parser.getNumber(2, offset)) {
+            emit logMessage("[Server] Malformed UPLOAD command.");
+            return;
+        }
 
-        bool compressed = (compressedStr == "1");
-        size_t fileSize = std::stoull(fileSizeStr);
-        size_t offset = std::stoull(offsetStr);
+        auto quotaHold = admitUpload(clientSocket, metadataDB, *config, fileName, uploader, fileSize);
+        if (!quotaHold) return;
 
-        std::string filePath = storagePath_ + "/" + fileName;
-        std::ofstream outFile(filePath, std::ios::binary | std::ios::app);
-        if (!outFile.is_open()) {
+        if (!compressed && offset == 0 && fileSize > 0 && fileSize <= config->packMaxFileBytes &&
+            packStore_.isOpen()) {
+            receivePacked(clientSocket, metadataDB, fileName, uploader, fileSize, payload);
+            return;
+        }
+
+        // Data lands in a staging file and replaces filePath only once complete.
+        auto staging = committer_.stage(storagePath_, fileName, uploader);
+        if (!staging) {
+            std::string response = "BUSY " + std::to_string(config->busyRetryAfterSeconds) + "\n";
+            send(clientSocket, response.c_str(), static_cast<int>(response.size()), 0);
+            emit logMessage(QString("[Server] %1 is already being uploaded by %2.")
+                .arg(QString::fromStdString(fileName)).arg(QString::fromStdString(uploader)));
+            return;
+        }
+        std::string relativePath = StorageLayout::shardedPath(fileName);
+        std::string filePath = storagePath_ + "/" + relativePath;
+        const std::string& stagedPath = staging.path();
+
+        // A resumed upload continues from the client's offset: bytes staged
+        // past it were never confirmed, and offset 0 starts the file over.
+        std::error_code ec;
+        uint64_t stored = fs::exists(stagedPath, ec) ? fs::file_size(stagedPath, ec) : 0;
+        if (stored < offset) {
+            emit logMessage(QString("[Server] Cannot resume %1 at offset %2, only %3 bytes stored.")
+                .arg(QString::fromStdString(fileName)).arg(offset).arg(stored));
+            return;
+        }
+
+        UploadFile outFile;
+        if (!outFile.open(stagedPath, offset)) {
             emit logMessage(QString("[Server] Failed to open file for writing: %1")
-                .arg(QString::fromStdString(filePath)));
-            closesocket(clientSocket);
+                .arg(QString::fromStdString(stagedPath)));
+            return;
+        }
+
+        // Reserve the rest of the file before taking any data, so a full disk
+        // is reported now instead of partway through, and large uploads get
+        // contiguous extents. Without fallocate, check free space instead.
+        uint64_t remaining = fileSize - offset;
+        bool preallocate = config->uploadPreallocate;
+        UploadFile::Allocation allocation = preallocate
+            ? outFile.preallocate(offset, remaining) : UploadFile::Allocation::Unsupported;
+        // Without a reservation, skipped zero blocks can stay holes.
+        if (!preallocate) outFile.markSparse();
+        if (allocation == UploadFile::Allocation::Unsupported || allocation == UploadFile::Allocation::Failed) {
+            fs::space_info space = fs::space(storagePath_, ec);
+            if (!ec && space.available < remaining) allocation = UploadFile::Allocation::NoSpace;
+        }
+        if (allocation == UploadFile::Allocation::NoSpace) {
+            outFile.finish(offset);
+            std::string response = "NOSPACE " + std::to_string(remaining) + "\n";
+            send(clientSocket, response.c_str(), static_cast<int>(response.size()), 0);
+            emit logMessage(QString("[Server] Upload of %1 refused: no space for %2 bytes.")
+                .arg(QString::fromStdString(fileName)).arg(remaining));
             return;
         }
 
+        // Reading slower than the client sends backs TCP up to the client,
+        // which is how the bandwidth limits reach it.
+        auto shaping = shaper_.openSession(uploader);
+        TransferClass transferClass = (fileSize - offset <= config->interactiveMaxBytes || offset > 0)
+            ? TransferClass::Interactive : TransferClass::Bulk;
+
         size_t totalReceived = offset;
-        char chunk[FileTransferEngine::CHUNK_SIZE];
-        while (totalReceived < fileSize) {
-            int received = recv(clientSocket, chunk, FileTransferEngine::CHUNK_SIZE, 0);
+        bool writeFailed = false;
+        if (!payload.empty() && totalReceived < fileSize) {
+            size_t take = std::min(payload.size(), fileSize - totalReceived);
+            {
+                auto slot = transferScheduler_.acquire(transferClass, take);
+                writeFailed = !outFile.writeAt(payload.data(), take, totalReceived);
+            }
+            if (!writeFailed) {
+                totalReceived += take;
+                shaping->throttle(take);
+            }
+        }
+
+        std::vector<char> chunk(config->uploadChunkBytes);
+        while (!writeFailed && totalReceived < fileSize) {
+            int received = recv(clientSocket, chunk.data(),
+                static_cast<int>(std::min<size_t>(chunk.size(), fileSize - totalReceived)), 0);
             if (received <= 0) break;
-            outFile.write(chunk, received);
+            {
+                auto slot = transferScheduler_.acquire(transferClass, static_cast<uint64_t>(received));
+                writeFailed = !outFile.writeAt(chunk.data(), static_cast<size_t>(received), totalReceived);
+            }
+            if (writeFailed) break;
             totalReceived += received;
+            shaping->throttle(static_cast<uint64_t>(received));
+            LOG_EVENT_DEBUG(LogEvent::UploadChunkReceived, fileName, totalReceived, fileSize);
         }
-        outFile.close();
+        // Also trims the reservation back to what arrived if the upload stopped short.
+        outFile.finish(totalReceived);
+        if (writeFailed)
+            emit logMessage(QString("[Server] Write to %1 failed at offset %2.")
+                .arg(QString::fromStdString(fileName)).arg(totalReceived));
 
+        // Client gone or cut off by a drain: what arrived stays staged for the
+        // client to resume from; nothing is published until the upload completes.
+        if (totalReceived < fileSize) {
+            emit logMessage(QString("[Server] Upload of %1 interrupted at %2/%3 bytes, kept for resume.")
+                .arg(QString::fromStdString(fileName)).arg(totalReceived).arg(fileSize));
+            return;
+        }
+
+        // Decompression and hashing go through the scheduler so a large upload
+        // spreads over idle cores; small ones run inline and skip the queue.
+        // The metadata commit stays here, on this connection's SQLite handle.
+        // Quota and the space check above admitted the compressed length; the
+        // stored file is the inflated output, so that is bounded by the quota
+        // and free space left and re-admitted at its real size.
+        uint64_t storedSize = fileSize;
         if (compressed) {
-            std::string decompressedPath = storagePath_ + "/" + fileName + "_decompressed";
-            CompressionHelper::decompressFile(filePath, decompressedPath);
-            fs::remove(filePath);
-            fs::rename(decompressedPath, filePath);
+            uint64_t quota = config->quotaFor(uploader);
+            auto usage = [&] { return committedUsage(metadataDB, fileName, uploader); };
+            uint64_t limit = quotaLedger_.headroom(quotaHold, quota, usage);
+            fs::space_info space = fs::space(storagePath_, ec);
+            bool diskBound = !ec && space.available < limit;
+            if (diskBound) limit = space.available;
+
+            bool inflated = false;
+            bool overLimit = false;
+            auto decompress = [&] {
+                std::string decompressedPath = stagedPath + ".inflate";
+                std::error_code inflateEc;
+                inflated = CompressionHelper::decompressFile(stagedPath, decompressedPath, limit, overLimit);
+                // The rename replaces the compressed copy only once the
+                // output is whole; a failed one leaves it staged as received.
+                if (inflated) {
+                    fs::rename(decompressedPath, stagedPath, inflateEc);
+                    inflated = !inflateEc;
+                }
+                if (!inflated) fs::remove(decompressedPath, inflateEc);
+            };
+            if (fileSize < FileChecksum::SEGMENT_SIZE) {
+                decompress();
+            }
+            else {
+                TaskGroup stage(*scheduler_);
+                stage.run(decompress);
+                stage.wait();
+            }
+            uint64_t projected = 0;
+            if (inflated) {
+                storedSize = fs::file_size(stagedPath, ec);
+                inflated = !ec;
+            }
+            if (overLimit || (inflated && !quotaLedger_.resize(quotaHold, storedSize, quota, usage, projected))) {
+                committer_.discard(staging);
+                std::string response = diskBound && overLimit ? "NOSPACE " + std::to_string(limit) + "\n"
+                    : "QUOTA " + std::to_string(quota) + "\n";
+                send(clientSocket, response.c_str(), static_cast<int>(response.size()), 0);
+                if (overLimit)
+                    emit logMessage(QString("[Server] Upload of %1 by %2 refused: it inflates past the %3 bytes %4.")
+                        .arg(QString::fromStdString(fileName)).arg(QString::fromStdString(uploader))
+                        .arg(limit).arg(diskBound ? "free on disk" : "left in quota"));
+                else
+                    emit logMessage(QString("[Server] Upload of %1 by %2 refused: %3 bytes would exceed quota of %4.")
+                        .arg(QString::fromStdString(fileName)).arg(QString::fromStdString(uploader))
+                        .arg(projected).arg(quota));
+                return;
+            }
+            if (!inflated) {
+                send(clientSocket, "ERR decompress\n", 15, 0);
+                emit logMessage(QString("[Server] Could not decompress %1, upload stays staged.")
+                    .arg(QString::fromStdString(fileName)));
+                return;
+            }
+        }
+
+        // SHA-256 cannot be split like CRC32, so it runs as one task next to
+        // the segmented CRC.
+        std::string checksum;
+        std::string contentHash;
+        {
+            TaskGroup hashing(*scheduler_);
+            if (config->contentAddressed)
+                hashing.run([&] {
+                    if (!Sha256::hashFile(stagedPath, "", 0, UINT64_MAX, contentHash)) contentHash.clear();
+                });
+            uint32_t crc = 0;
+            if (FileChecksum::crc32File(stagedPath, scheduler_.get(), crc))
+                checksum = FileChecksum::toHex(crc);
         }
 
-        metadataDB.updateFileMetadata(fileName, uploader, fileSize);
+        // The fdatasync runs before the blob lock so commits of other uploads
+        // do not queue behind it. Likely duplicates skip it: their staged
+        // copy is dropped.
+        bool knownBlob = !contentHash.empty() && metadataDB.getBlob(contentHash).refcount > 0;
+        if (!knownBlob && !committer_.prepare(staging)) {
+            emit logMessage(QString("[Server] Could not publish %1, upload stays staged.")
+                .arg(QString::fromStdString(fileName)));
+            return;
+        }
+
+        // Content already stored as a blob: drop the staged copy and only
+        // add a reference. The blob lock keeps a concurrent replace from
+        // deleting the blob between that check and the reference.
+        std::unique_lock<std::mutex> blobLock(blobMutex_, std::defer_lock);
+        if (!contentHash.empty()) {
+            blobLock.lock();
+            relativePath = StorageLayout::blobPath(contentHash);
+            filePath = storagePath_ + "/" + relativePath;
+        }
+        FileMetadata previous = metadataDB.getFileMetadataRecord(fileName);
+        if (!previous.contentHash.empty() && !blobLock.owns_lock()) blobLock.lock();
+
+        bool duplicate = !contentHash.empty() && metadataDB.getBlob(contentHash).refcount > 0 &&
+            fs::exists(filePath, ec);
+        if (duplicate) {
+            committer_.discard(staging);
+        }
+        else {
+            fs::create_directories(fs::path(filePath).parent_path(), ec);
+            if (!committer_.commit(staging, filePath)) {
+                emit logMessage(QString("[Server] Could not publish %1, upload stays staged.")
+                    .arg(QString::fromStdString(fileName)));
+                return;
+            }
+        }
+
+        metadataDB.updateFileMetadata(fileName, uploader, storedSize, checksum, relativePath, contentHash);
+        releaseReplaced(metadataDB, previous, relativePath);
+        if (blobLock.owns_lock()) blobLock.unlock();
+        committer_.finish(staging);
+        invalidateDerived(fileName);
+        send(clientSocket, "OK\n", 3, 0);
+        if (duplicate)
+            emit logMessage(QString("[Server] %1 has the same content as a stored blob, stored as a reference.")
+                .arg(QString::fromStdString(fileName)));
         emit logMessage(QString("[Server] Upload complete: %1 by %2")
             .arg(QString::fromStdString(fileName))
             .arg(QString::fromStdString(uploader)));
@@ -185,6 +1332,45 @@ void ServerApp::handleClient(SOCKET clientSocket)
         // 🔔 Notify UI to refresh list
         emit fileUploaded(QString::fromStdString(fileName));
     }
+    else if (command == CommandType::UploadRef) {
+        handleUploadRef(clientSocket, metadataDB, *config, parser);
+    }
+    else if (command == CommandType::Download) {
+        handleDownload(clientSocket, metadataDB, *config, parser);
+    }
+    else if (command == CommandType::List) {
+        // LIST <pageSize> <cursor|-> [prefix]
+        size_t pageSize = DEFAULT_LIST_PAGE_SIZE;
+        parser.getNumber(0, pageSize);
+        std::string_view cursorArg = parser.getArg(1);
+        std::string cursor(cursorArg == "-" ? std::string_view() : cursorArg);
+        std::string prefix(parser.getArg(2));
 
-    closesocket(clientSocket);
+        FileListPage page = metadataDB.listFiles(cursor, pageSize, prefix);
+        if (page.invalidCursor) {
+            std::string reply = "ERR cursor\n";
+            sendSlotted(clientSocket, reply.data(), reply.size(), TransferClass::Interactive);
+            return;
+        }
+
+        std::string response = formatFileEntries(page.entries);
+        response += "END " + (page.nextCursor.empty() ? std::string("-") : page.nextCursor) + "\n";
+        sendSlotted(clientSocket, response.data(), response.size(), TransferClass::Interactive);
+    }
+    else if (command == CommandType::Search) {
+        // SEARCH <limit> <term> [term...]
+        size_t limit = DEFAULT_LIST_PAGE_SIZE;
+        parser.getNumber(0, limit);
+        std::string query(parser.getRest(1));
+
+        std::string response = formatFileEntries(metadataDB.searchFiles(query, limit));
+        response += "END -\n";
+        sendSlotted(clientSocket, response.data(), response.size(), TransferClass::Interactive);
+    }
+    else if (command == CommandType::Caps) {
+        // CAPS: the optional commands this server takes, so clients skip
+        // the ones that would only be refused.
+        std::string response = std::string("CAPS") + (config->contentAddressed ? " uploadref" : "") + "\n";
+        engine.sendAll((int)clientSocket, response.c_str(), response.size());
+    }
 }
@@ -0,0 +1,44 @@
+#include "StorageLayout.hpp"
+#include "MetadataManager.hpp"
+
+namespace {
+
+uint64_t fnv1a(const std::string& text)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+}
+
+std::string StorageLayout::shardedPath(const std::string& fileName)
+{
+    static const char digits[] = "0123456789abcdef";
+    uint64_t hash = fnv1a(fileName);
+
+    std::string path;
+    path.reserve(fileName.size() + 6);
+    path += digits[(hash >> 60) & 0xF];
+    path += digits[(hash >> 56) & 0xF];
+    path += '/';
+    path += digits[(hash >> 52) & 0xF];
+    path += digits[(hash >> 48) & 0xF];
+    path += '/';
+    path += fileName;
+    return path;
+}
+
+std::string StorageLayout::blobPath(const std::string& contentHash)
+{
+    if (contentHash.size() < 4) return "blobs/" + contentHash;
+    return "blobs/" + contentHash.substr(0, 2) + "/" + contentHash.substr(2, 2) + "/" + contentHash;
+}
+
+std::string StorageLayout::resolve(const std::string& storageRoot, const FileMetadata& meta)
+{
+    return storageRoot + "/" + (meta.storagePath.empty() ? meta.fileName : meta.storagePath);
+}
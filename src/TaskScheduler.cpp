@@ -0,0 +1,159 @@
+#include "TaskScheduler.hpp"
+#include "Logger.hpp"
+#include <exception>
+
+namespace {
+
+// Queue index of the scheduler worker running on this thread.
+thread_local const TaskScheduler* currentScheduler = nullptr;
+thread_local size_t currentWorker = 0;
+
+}
+
+TaskScheduler::TaskScheduler(size_t threadCount)
+{
+    if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 2;
+
+    for (size_t i = 0; i < threadCount; ++i)
+        queues_.push_back(std::make_unique<WorkQueue>());
+    for (size_t i = 0; i < threadCount; ++i)
+        threads_.emplace_back(&TaskScheduler::workerLoop, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    shutdown();
+}
+
+void TaskScheduler::submit(Task task)
+{
+    // Tasks forked by a worker stay on its own deque (hot in its cache);
+    // everything else is dealt out round-robin.
+    size_t index = isWorkerThread() ? currentWorker : nextQueue_++ % queues_.size();
+    {
+        // Count first so a pop can never take queued_ below zero.
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        ++queued_;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    sleepCv_.notify_one();
+}
+
+bool TaskScheduler::isWorkerThread() const
+{
+    return currentScheduler == this;
+}
+
+bool TaskScheduler::popTask(size_t index, Task& task)
+{
+    // Own deque first, newest task (LIFO)...
+    {
+        WorkQueue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued_;
+            return true;
+        }
+    }
+    // ...then steal the oldest task of another worker (FIFO).
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        WorkQueue& victim = *queues_[(index + i) % queues_.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty()) continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        --queued_;
+        return true;
+    }
+    return false;
+}
+
+bool TaskScheduler::runPendingTask()
+{
+    Task task;
+    size_t index = isWorkerThread() ? currentWorker : 0;
+    if (!popTask(index, task)) return false;
+    runTask(task);
+    return true;
+}
+
+void TaskScheduler::runTask(Task& task)
+{
+    try {
+        task();
+    }
+    catch (const std::exception& e) {
+        Logger::error(std::string("[Scheduler] Task failed: ") + e.what());
+    }
+}
+
+void TaskScheduler::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    sleepCv_.notify_all();
+    for (auto& thread : threads_)
+        if (thread.joinable()) thread.join();
+    threads_.clear();
+}
+
+void TaskScheduler::workerLoop(size_t index)
+{
+    currentScheduler = this;
+    currentWorker = index;
+
+    for (;;) {
+        Task task;
+        if (popTask(index, task)) {
+            runTask(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        if (stopping_ && queued_ == 0) break;
+        // A task counted in queued_ may sit behind a try_lock we skipped; wake up to retry.
+        sleepCv_.wait_for(lock, std::chrono::milliseconds(50),
+            [this] { return queued_ > 0 || stopping_; });
+    }
+}
+
+void TaskGroup::run(TaskScheduler::Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++pending_;
+    }
+    scheduler_.submit([this, task = std::move(task)] {
+        try {
+            task();
+        }
+        catch (const std::exception& e) {
+            Logger::error(std::string("[Scheduler] Task failed: ") + e.what());
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) cv_.notify_all();
+    });
+}
+
+void TaskGroup::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!scheduler_.isWorkerThread()) {
+        cv_.wait(lock, [this] { return pending_ == 0; });
+        return;
+    }
+
+    while (pending_ > 0) {
+        lock.unlock();
+        if (!scheduler_.runPendingTask()) std::this_thread::yield();
+        lock.lock();
+    }
+}
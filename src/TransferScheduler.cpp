@@ -0,0 +1,56 @@
+#include "TransferScheduler.hpp"
+#include <algorithm>
+
+TransferScheduler::TransferScheduler(size_t slots, unsigned interactiveWeight, unsigned bulkWeight)
+    : slots_(slots)
+{
+    configure(slots, interactiveWeight, bulkWeight);
+}
+
+void TransferScheduler::configure(size_t slots, unsigned interactiveWeight, unsigned bulkWeight)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_ = std::max<size_t>(1, slots);
+        weights_[static_cast<size_t>(TransferClass::Interactive)] = std::max(1u, interactiveWeight);
+        weights_[static_cast<size_t>(TransferClass::Bulk)] = std::max(1u, bulkWeight);
+    }
+    cv_.notify_all();
+}
+
+TransferScheduler::Slot TransferScheduler::acquire(TransferClass cls, uint64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Uncontended: take the slot without queueing.
+    if (inUse_ < slots_ && waiting_.empty()) {
+        ++inUse_;
+        return Slot(this);
+    }
+
+    size_t index = static_cast<size_t>(cls);
+    double start = std::max(virtualTime_, lastFinish_[index]);
+    Waiter self{ start + static_cast<double>(std::max<uint64_t>(bytes, 1)) / weights_[index], nextSequence_++ };
+    lastFinish_[index] = self.finish;
+    waiting_.push(self);
+
+    cv_.wait(lock, [&] {
+        return inUse_ < slots_ && waiting_.top().sequence == self.sequence;
+    });
+    waiting_.pop();
+    virtualTime_ = std::max(virtualTime_, self.finish);
+    ++inUse_;
+
+    // More slots may be free for the next waiter in line.
+    if (!waiting_.empty() && inUse_ < slots_) cv_.notify_all();
+    return Slot(this);
+}
+
+void TransferScheduler::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --inUse_;
+    }
+    cv_.notify_all();
+}
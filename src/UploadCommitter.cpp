@@ -0,0 +1,281 @@
+#include "UploadCommitter.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+UploadCommitter::Stage::~Stage()
+{
+    if (owner_) owner_->release(path_);
+}
+
+UploadCommitter::~UploadCommitter()
+{
+    shutdown();
+}
+
+void UploadCommitter::configure(FsyncPolicy policy, int batchMs)
+{
+    std::vector<std::string> flushNow;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        policy_ = policy;
+        batchMs_ = std::max(1, batchMs);
+        if (policy_ == FsyncPolicy::Batched && !batchThread_.joinable() && !stopping_)
+            batchThread_ = std::thread(&UploadCommitter::batchLoop, this);
+        // Leaving Batched must not strand files that were waiting for it.
+        if (policy_ != FsyncPolicy::Batched) flushNow.swap(pending_);
+    }
+    cv_.notify_all();
+    syncBatch(flushNow);
+}
+
+UploadCommitter::Stage UploadCommitter::stage(const std::string& storageDir, const std::string& fileName,
+    const std::string& uploader)
+{
+    fs::path dir = stagingDirFor(storageDir, uploader);
+    std::string path = (dir / (fileName + ".part")).string();
+
+    // Created under the lock so sweep() never removes the directory between
+    // here and the claim.
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (!staging_.insert(path).second) return Stage();
+    return Stage(this, path);
+}
+
+std::string UploadCommitter::stagingDirFor(const std::string& storageDir, const std::string& uploader)
+{
+    static const char* digits = "0123456789abcdef";
+    std::string name = "u";     // never empty, never "." or ".."
+    for (unsigned char c : uploader) {
+        name += digits[c >> 4];
+        name += digits[c & 0x0F];
+    }
+    return (fs::path(storageDir) / STAGING_DIR / name).string();
+}
+
+void UploadCommitter::release(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    staging_.erase(path);
+}
+
+bool UploadCommitter::prepare(Stage& stage)
+{
+    FsyncPolicy policy;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        policy = policy_;
+    }
+    if (policy != FsyncPolicy::PerFile) return true;
+    stage.synced_ = syncFile(stage.path());
+    return stage.synced_;
+}
+
+bool UploadCommitter::commit(Stage& stage, const std::string& finalPath)
+{
+    FsyncPolicy policy;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        policy = policy_;
+    }
+
+    // Data before the rename, so a crash never publishes a name whose
+    // blocks were not written yet.
+    if (policy == FsyncPolicy::PerFile && !stage.synced_ && !syncFile(stage.path())) return false;
+
+    std::error_code ec;
+    fs::rename(stage.path(), finalPath, ec);
+    if (ec) {
+        Logger::error("[Server] Commit of " + finalPath + " failed: " + ec.message());
+        return false;
+    }
+
+    if (policy == FsyncPolicy::PerFile && stage.synced_) {
+        stage.pendingDir_ = fs::path(finalPath).parent_path().string();
+    }
+    else if (policy == FsyncPolicy::PerFile) {
+        syncDirectory(fs::path(finalPath).parent_path().string());
+    }
+    else if (policy == FsyncPolicy::Batched) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(finalPath);
+        }
+        cv_.notify_all();
+    }
+    return true;
+}
+
+void UploadCommitter::finish(Stage& stage)
+{
+    if (stage.pendingDir_.empty()) return;
+    syncDirectory(stage.pendingDir_);
+    stage.pendingDir_.clear();
+}
+
+void UploadCommitter::discard(const Stage& stage)
+{
+    std::error_code ec;
+    fs::remove(stage.path(), ec);
+}
+
+bool UploadCommitter::syncAppended(const std::string& path)
+{
+    FsyncPolicy policy;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        policy = policy_;
+        if (policy == FsyncPolicy::Batched &&
+            std::find(pending_.begin(), pending_.end(), path) == pending_.end())
+            pending_.push_back(path);
+    }
+    if (policy == FsyncPolicy::Batched) cv_.notify_all();
+    return policy != FsyncPolicy::PerFile || syncFile(path);
+}
+
+uint64_t UploadCommitter::stagedBytes(const std::string& storageDir, const std::string& uploader,
+    const std::string& exceptFile) const
+{
+    std::string except = exceptFile + ".part";
+    uint64_t total = 0;
+    std::error_code ec;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : fs::directory_iterator(stagingDirFor(storageDir, uploader), ec)) {
+        if (entry.path().filename().string() == except || staging_.count(entry.path().string())) continue;
+        std::error_code entryEc;
+        uint64_t size = entry.file_size(entryEc);
+        if (!entryEc) total += size;
+    }
+    return total;
+}
+
+int UploadCommitter::sweep(const std::string& storageDir, std::chrono::seconds maxAge)
+{
+    int removed = 0;
+    auto cutoff = fs::file_time_type::clock::now() - maxAge;
+    std::error_code ec;
+    std::vector<fs::path> uploaderDirs;
+    // Held throughout so stage() cannot claim a file while it is judged stale.
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : fs::recursive_directory_iterator(fs::path(storageDir) / STAGING_DIR, ec)) {
+        std::error_code entryEc;
+        if (entry.is_directory(entryEc)) {
+            uploaderDirs.push_back(entry.path());
+            continue;
+        }
+        if (staging_.count(entry.path().string()) || !entry.is_regular_file(entryEc) ||
+            entry.last_write_time(entryEc) > cutoff || entryEc) continue;
+        if (fs::remove(entry.path(), entryEc)) ++removed;
+    }
+    // Empty uploader directories go too, unless a claimed upload is about
+    // to create its file in one.
+    for (const auto& dir : uploaderDirs) {
+        bool claimed = std::any_of(staging_.begin(), staging_.end(),
+            [&dir](const std::string& path) { return fs::path(path).parent_path() == dir; });
+        std::error_code dirEc;
+        if (!claimed && fs::is_empty(dir, dirEc)) fs::remove(dir, dirEc);
+    }
+    return removed;
+}
+
+void UploadCommitter::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (batchThread_.joinable()) batchThread_.join();
+
+    std::vector<std::string> remaining;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        remaining.swap(pending_);
+        stopping_ = false;      // a later configure() may start a new batch thread
+    }
+    syncBatch(remaining);
+}
+
+// Group commit: waits for the first pending file, lets the batch window
+// collect more, then syncs them all and each directory once.
+void UploadCommitter::batchLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (stopping_) break;
+
+        int batchMs = batchMs_;
+        cv_.wait_for(lock, std::chrono::milliseconds(batchMs), [this] { return stopping_; });
+
+        std::vector<std::string> files;
+        files.swap(pending_);
+        lock.unlock();
+        syncBatch(files);
+        lock.lock();
+    }
+}
+
+void UploadCommitter::syncBatch(std::vector<std::string>& files)
+{
+    if (files.empty()) return;
+
+    std::vector<std::string> dirs;
+    for (const auto& file : files) {
+        syncFile(file);
+        dirs.push_back(fs::path(file).parent_path().string());
+    }
+    std::sort(dirs.begin(), dirs.end());
+    dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+    for (const auto& dir : dirs) syncDirectory(dir);
+    files.clear();
+}
+
+bool UploadCommitter::syncFile(const std::string& path)
+{
+#ifdef _WIN32
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) return false;
+    bool ok = FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(fd))) != 0;
+    _close(fd);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+#ifdef __APPLE__
+    bool ok = ::fsync(fd) == 0;
+#else
+    bool ok = ::fdatasync(fd) == 0;
+#endif
+    ::close(fd);
+#endif
+    if (!ok) Logger::error("[Server] Sync of " + path + " failed.");
+    return ok;
+}
+
+bool UploadCommitter::syncDirectory(const std::string& dir)
+{
+#ifdef _WIN32
+    // NTFS journals the rename itself; directories cannot be flushed.
+    (void)dir;
+    return true;
+#else
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
@@ -0,0 +1,139 @@
+#include "UploadFile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool isZeroBlock(const char* data, size_t length)
+{
+    // Compare the block against itself shifted by one byte: all bytes are
+    // equal, and the first is zero.
+    return length > 0 && data[0] == 0 && std::memcmp(data, data + 1, length - 1) == 0;
+}
+
+}
+
+UploadFile::~UploadFile()
+{
+    if (fd_ < 0) return;
+#ifdef _WIN32
+    _close(fd_);
+#else
+    ::close(fd_);
+#endif
+}
+
+bool UploadFile::open(const std::string& path, uint64_t offset)
+{
+#ifdef _WIN32
+    fd_ = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+    if (fd_ < 0) return false;
+    return _chsize_s(fd_, static_cast<__int64>(offset)) == 0;
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) return false;
+    return ::ftruncate(fd_, static_cast<off_t>(offset)) == 0;
+#endif
+}
+
+UploadFile::Allocation UploadFile::preallocate(uint64_t offset, uint64_t length)
+{
+    if (length == 0) return Allocation::Reserved;
+#if defined(_WIN32)
+    FILE_ALLOCATION_INFO info{};
+    info.AllocationSize.QuadPart = static_cast<LONGLONG>(offset + length);
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(fd_));
+    if (SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(info))) return Allocation::Reserved;
+    DWORD error = GetLastError();
+    if (error == ERROR_DISK_FULL || error == ERROR_HANDLE_DISK_FULL) return Allocation::NoSpace;
+    return Allocation::Unsupported;
+#elif defined(__linux__)
+    if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(length)) == 0) {
+        reservedEnd_ = offset + length;
+        return Allocation::Reserved;
+    }
+    if (errno == ENOSPC || errno == EDQUOT || errno == EFBIG) return Allocation::NoSpace;
+    if (errno == EOPNOTSUPP || errno == ENOSYS) return Allocation::Unsupported;
+    return Allocation::Failed;
+#else
+    (void)offset;
+    return Allocation::Unsupported;
+#endif
+}
+
+bool UploadFile::markSparse()
+{
+#ifdef _WIN32
+    DWORD returned = 0;
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(fd_));
+    return DeviceIoControl(handle, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr) != 0;
+#else
+    return fd_ >= 0;
+#endif
+}
+
+bool UploadFile::writeAt(const char* data, size_t length, uint64_t offset)
+{
+    // Write runs of data between whole zero blocks; block boundaries are
+    // taken from the file offset so skipped ranges line up with the disk.
+    size_t runStart = 0;
+    size_t pos = 0;
+    while (pos < length) {
+        size_t blockEnd = std::min(length, pos + BLOCK_SIZE - static_cast<size_t>((offset + pos) % BLOCK_SIZE));
+        if (blockEnd - pos == BLOCK_SIZE && isZeroBlock(data + pos, BLOCK_SIZE)) {
+            if (pos > runStart && !writeRun(data + runStart, pos - runStart, offset + runStart)) return false;
+            runStart = blockEnd;
+        }
+        pos = blockEnd;
+    }
+    return runStart >= length || writeRun(data + runStart, length - runStart, offset + runStart);
+}
+
+bool UploadFile::writeRun(const char* data, size_t length, uint64_t offset)
+{
+    while (length > 0) {
+#ifdef _WIN32
+        if (_lseeki64(fd_, static_cast<__int64>(offset), SEEK_SET) < 0) return false;
+        int written = _write(fd_, data, static_cast<unsigned>(std::min<size_t>(length, 1u << 30)));
+#else
+        ssize_t written = ::pwrite(fd_, data, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) continue;
+#endif
+        if (written <= 0) return false;
+        data += written;
+        length -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+bool UploadFile::finish(uint64_t size)
+{
+    if (fd_ < 0) return false;
+#ifdef _WIN32
+    bool ok = _chsize_s(fd_, static_cast<__int64>(size)) == 0;
+    ok = _close(fd_) == 0 && ok;
+#else
+    bool ok = ::ftruncate(fd_, static_cast<off_t>(size)) == 0;
+#ifdef __linux__
+    // Truncating does not always drop blocks reserved past end-of-file.
+    if (reservedEnd_ > size)
+        ::fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            static_cast<off_t>(size), static_cast<off_t>(reservedEnd_ - size));
+#endif
+    ok = ::close(fd_) == 0 && ok;
+#endif
+    fd_ = -1;
+    return ok;
+}
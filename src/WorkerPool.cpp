@@ -0,0 +1,167 @@
+#include "WorkerPool.hpp"
+#include "Logger.hpp"
+#include <exception>
+#include <algorithm>
+
+WorkerPool::WorkerPool(size_t workerCount, size_t maxQueued)
+    : maxQueued_(maxQueued)
+{
+    resize(workerCount, maxQueued);
+    reaper_ = std::thread(&WorkerPool::reaperLoop, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    shutdown();
+}
+
+bool WorkerPool::submit(Job run, Job reject, std::chrono::milliseconds queueTimeout)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || closed_) return false;
+        // Every worker busy and maxQueued_ jobs already waiting behind them
+        if (active_ + queue_.size() >= targetWorkers_ + maxQueued_)
+            return false;
+        queue_.push_back({ std::move(run), std::move(reject),
+            std::chrono::steady_clock::now() + queueTimeout });
+    }
+    cv_.notify_one();
+    reaperCv_.notify_one();
+    return true;
+}
+
+void WorkerPool::resize(size_t workerCount, size_t maxQueued)
+{
+    if (workerCount == 0) workerCount = 1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) return;
+        maxQueued_ = maxQueued;
+        targetWorkers_ = workerCount;
+        while (liveWorkers_ < targetWorkers_) {
+            workers_.emplace_back(&WorkerPool::workerLoop, this);
+            ++liveWorkers_;
+        }
+    }
+    cv_.notify_all();
+}
+
+void WorkerPool::closeQueue()
+{
+    std::deque<QueuedJob> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        abandoned.swap(queue_);
+    }
+    for (auto& job : abandoned)
+        if (job.reject) job.reject();
+}
+
+void WorkerPool::shutdown()
+{
+    std::deque<QueuedJob> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ && liveWorkers_ == 0) return;
+        stopping_ = true;
+        abandoned.swap(queue_);
+    }
+    cv_.notify_all();
+    reaperCv_.notify_all();
+
+    for (auto& job : abandoned)
+        if (job.reject) job.reject();
+    if (reaper_.joinable()) reaper_.join();
+
+    for (auto& worker : workers_)
+        if (worker.joinable()) worker.join();
+    std::lock_guard<std::mutex> lock(mutex_);
+    workers_.clear();
+    liveWorkers_ = 0;
+}
+
+size_t WorkerPool::activeCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return active_;
+}
+
+size_t WorkerPool::queuedCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+// Rejects queued jobs whose deadline passed. Timeouts can differ between
+// jobs (they follow config reloads), so the queue is scanned for the
+// earliest one rather than assuming FIFO order.
+void WorkerPool::reaperLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (queue_.empty()) {
+            reaperCv_.wait(lock);
+            continue;
+        }
+
+        auto earliest = std::min_element(queue_.begin(), queue_.end(),
+            [](const QueuedJob& a, const QueuedJob& b) { return a.deadline < b.deadline; })->deadline;
+        if (reaperCv_.wait_until(lock, earliest) == std::cv_status::no_timeout) continue;
+
+        std::vector<QueuedJob> expired;
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = queue_.begin(); it != queue_.end();) {
+            if (it->deadline <= now) {
+                expired.push_back(std::move(*it));
+                it = queue_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        if (expired.empty()) continue;
+
+        lock.unlock();
+        for (auto& job : expired) {
+            try {
+                if (job.reject) job.reject();
+            }
+            catch (const std::exception& e) {
+                Logger::error(std::string("[WorkerPool] Reject failed: ") + e.what());
+            }
+        }
+        lock.lock();
+    }
+}
+
+void WorkerPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        cv_.wait(lock, [this] { return stopping_ || !queue_.empty() || liveWorkers_ > targetWorkers_; });
+        if (liveWorkers_ > targetWorkers_ && !stopping_) {
+            --liveWorkers_;             // retired by resize()
+            return;
+        }
+        if (queue_.empty()) return;     // stopping and nothing left
+
+        QueuedJob job = std::move(queue_.front());
+        queue_.pop_front();
+        bool expired = std::chrono::steady_clock::now() > job.deadline;
+        ++active_;
+        lock.unlock();
+
+        try {
+            if (!expired) job.run();
+            else if (job.reject) job.reject();
+        }
+        catch (const std::exception& e) {
+            Logger::error(std::string("[WorkerPool] Job failed: ") + e.what());
+        }
+
+        lock.lock();
+        --active_;
+    }
+}
@@ -1,10 +1,12 @@
 #include <QApplication>
 #include "ClientWindow.hpp"
 #include "ClientApp.hpp"
+#include "Logger.hpp"
 
 int main(int argc, char* argv[])
 {
     QApplication app(argc, argv);
+    Logger::init("logs/ftp_lite_client.log");
 
     // Create backend logic
     auto clientApp = std::make_shared<ClientApp>("client_config.json");
@@ -16,5 +18,7 @@ int main(int argc, char* argv[])
     window.resize(600, 400);
     window.show();
 
-    return app.exec();
+    int rc = app.exec();
+    Logger::shutdown();
+    return rc;
 }
@@ -0,0 +1,137 @@
+// ftp_lite_logdecode: renders the structured "<logFile>.bin" records written
+// by Logger::event / LOG_EVENT_* as text, using the table in LogEvents.hpp.
+#include "LogEvents.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* levelName(uint16_t level) {
+    switch (level) {
+    case 0:  return "DEBUG";
+    case 2:  return "ERROR";
+    default: return "INFO";
+    }
+}
+
+template <typename T>
+bool readValue(const std::vector<char>& record, size_t& pos, T& value) {
+    if (pos + sizeof(T) > record.size()) return false;
+    std::memcpy(&value, record.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+// Decodes the typed arguments that follow the event id.
+bool decodeArgs(const std::vector<char>& record, size_t pos, std::vector<std::string>& args) {
+    while (pos < record.size()) {
+        char tag = record[pos++];
+        switch (tag) {
+        case 'i': { int64_t v; if (!readValue(record, pos, v)) return false; args.push_back(std::to_string(v)); break; }
+        case 'u': { uint64_t v; if (!readValue(record, pos, v)) return false; args.push_back(std::to_string(v)); break; }
+        case 'd': {
+            double v;
+            if (!readValue(record, pos, v)) return false;
+            char text[32];
+            std::snprintf(text, sizeof(text), "%g", v);
+            args.emplace_back(text);
+            break;
+        }
+        case 's': {
+            uint16_t length;
+            if (!readValue(record, pos, length) || pos + length > record.size()) return false;
+            args.emplace_back(record.data() + pos, length);
+            pos += length;
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string render(const LogEventInfo* info, uint16_t eventId, const std::vector<std::string>& args) {
+    if (!info) {
+        std::string text = "event#" + std::to_string(eventId);
+        for (const auto& arg : args) text += " " + arg;
+        return text;
+    }
+
+    std::string text;
+    size_t next = 0;
+    for (const char* p = info->format; *p; ++p) {
+        if (p[0] == '{' && p[1] == '}') {
+            text += next < args.size() ? args[next++] : "?";
+            ++p;
+        }
+        else {
+            text += *p;
+        }
+    }
+    for (; next < args.size(); ++next) text += " " + args[next];
+    return text;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: ftp_lite_logdecode <logfile.bin>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    char magic[sizeof(LOG_BINARY_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, LOG_BINARY_MAGIC, sizeof(magic)) != 0) {
+        std::cerr << argv[1] << " is not an FTP-Lite binary log" << std::endl;
+        return 1;
+    }
+
+    std::vector<char> record;
+    uint32_t size = 0;
+    while (in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+        record.resize(size);
+        if (!in.read(record.data(), size)) {
+            std::cerr << "Truncated record at end of file" << std::endl;
+            return 1;
+        }
+
+        size_t pos = 0;
+        uint64_t timestamp = 0;
+        uint16_t level = 0, eventId = 0;
+        std::vector<std::string> args;
+        if (!readValue(record, pos, timestamp) || !readValue(record, pos, level) ||
+            !readValue(record, pos, eventId) || !decodeArgs(record, pos, args)) {
+            std::cerr << "Malformed record skipped" << std::endl;
+            continue;
+        }
+
+        std::time_t seconds = static_cast<std::time_t>(timestamp / 1000000000ULL);
+        std::tm tm{};
+#ifdef _WIN32
+        localtime_s(&tm, &seconds);
+#else
+        localtime_r(&seconds, &tm);
+#endif
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        char millis[8];
+        std::snprintf(millis, sizeof(millis), ".%03u", static_cast<unsigned>((timestamp / 1000000ULL) % 1000));
+
+        std::cout << stamp << millis << " [" << levelName(level) << "] "
+            << render(findLogEvent(eventId), eventId, args) << "\n";
+    }
+    return 0;
+}
@@ -1,10 +1,12 @@
 #include <QApplication>
 #include "ServerWindow.hpp"
 #include "ServerApp.hpp"
+#include "Logger.hpp"
 
 int main(int argc, char* argv[])
 {
     QApplication app(argc, argv);
+    Logger::init("logs/ftp_lite_server.log");
 
     std::string configPath = (argc > 1) ? argv[1] : "config/server_config.json";
 
@@ -17,5 +19,7 @@ int main(int argc, char* argv[])
     window.resize(600, 400);
     window.show();
 
-    return app.exec();
+    int rc = app.exec();
+    Logger::shutdown();
+    return rc;
 }
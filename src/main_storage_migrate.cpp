@@ -0,0 +1,65 @@
+// ftp_lite_storage_migrate: moves files stored flat in the storage directory
+// (schema < 8) into the sharded layout of StorageLayout and records their new
+// location. Run it with the server stopped; it is safe to run again after an
+// interruption, and files already moved are skipped.
+#include "MetadataManager.hpp"
+#include "StorageLayout.hpp"
+#include "Logger.hpp"
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: ftp_lite_storage_migrate <storageDir> [server_metadata.db]" << std::endl;
+        return 1;
+    }
+
+    std::string storageRoot = argv[1];
+    std::string dbPath = argc > 2 ? argv[2] : "server_metadata.db";
+    Logger::init("logs/ftp_lite_storage_migrate.log");
+
+    size_t moved = 0, recorded = 0, missing = 0, failed = 0;
+    {
+        MetadataManager metadataDB(dbPath);
+        std::vector<std::string> names = metadataDB.getUnshardedFileNames();
+        std::cout << names.size() << " file(s) to migrate" << std::endl;
+
+        for (const auto& name : names) {
+            std::string relativePath = StorageLayout::shardedPath(name);
+            fs::path from = fs::path(storageRoot) / name;
+            fs::path to = fs::path(storageRoot) / relativePath;
+
+            std::error_code ec;
+            if (fs::exists(from, ec)) {
+                fs::create_directories(to.parent_path(), ec);
+                fs::rename(from, to, ec);
+                if (ec) {
+                    std::cerr << "Cannot move " << from.string() << ": " << ec.message() << std::endl;
+                    ++failed;
+                    continue;
+                }
+                ++moved;
+            }
+            else if (!fs::exists(to, ec)) {
+                // Nothing on disk under either name; leave the row for an operator to look at.
+                std::cerr << "Missing: " << name << std::endl;
+                ++missing;
+                continue;
+            }
+
+            // Moved now, or by an earlier run that stopped before recording it.
+            if (metadataDB.setStoragePath(name, relativePath)) ++recorded;
+            else ++failed;
+        }
+        metadataDB.checkpoint();
+    }
+
+    std::cout << "Moved " << moved << ", recorded " << recorded << ", missing " << missing
+        << ", failed " << failed << std::endl;
+    Logger::shutdown();
+    return failed == 0 ? 0 : 2;
+}